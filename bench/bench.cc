@@ -0,0 +1,734 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include <sqlite3.h>
+#include "WorldGeneration/world_generator.h"
+#include "chunk_store.h"
+#include "heightfield_clipmap.h"
+#include "job_system.h"
+#include "lod_loader.h"
+#include "lod_mesh_generator.h"
+#include "mesh_generator.h"
+#include "region.h"
+#include "undo_journal.h"
+
+/*
+  Micro-benchmarks for the client's meshing and world generation, without
+  graphics. Each case is a 3x3x3 block of chunks, either synthetic terrain
+  from a function of the global voxel position, terrain from the world
+  generator, or chunks recorded in a client database. The centre chunk is
+  meshed with the per-voxel and the bitmask mesher, which must agree, and
+  with the lod mesher at every level, and round tripped through the chunk
+  codec, which must give it back unchanged. Also times the codec against the
+  format before it, saving an edited chunk as an edit log, undoing an edit
+  through the undo journal, storing and loading a block of chunks with each
+  ChunkStore backend, remeshing a single slab, downsampling through the lod
+  cascade, building the far terrain heightfield and WorldGenerator::fill_chunk,
+  on its own and spread across the job system's workers, and the feature
+  noise of a section, column by column against a grid at a time.
+  Times are nanoseconds per full resolution voxel of the chunk. Vertices count
+  each cube face as the six it is drawn with.
+  Usage: bench [iterations] [--db path/to/db.sqlite] [--json results.json]
+*/
+
+using Terrain = std::function<Voxel(int x, int y, int z)>;
+using World = std::unordered_map<Location, Chunk, LocationHash>;
+
+struct Case {
+  std::string name;
+  World world;
+  Location location;
+};
+
+// results are written here so the work being timed can't be optimised away
+static volatile std::size_t sink;
+
+static std::uint32_t hash(int x, int y, int z) {
+  std::uint32_t h = x * 0x8da6b343u ^ y * 0xd8163841u ^ z * 0xcb1ab31fu;
+  h ^= h >> 15;
+  h *= 0x2c1b3c6du;
+  h ^= h >> 12;
+  return h;
+}
+
+// Average nanoseconds per call of f
+template <typename F>
+static double time_ns(int iterations, F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < iterations; ++i)
+    f();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+static World make_world(const Terrain& terrain) {
+  constexpr int n = Chunk::sz_x;
+  World world;
+  for (int cz = -1; cz <= 1; ++cz) {
+    for (int cy = -1; cy <= 1; ++cy) {
+      for (int cx = -1; cx <= 1; ++cx) {
+        Chunk chunk(cx, cy, cz);
+        for (int z = 0; z < n; ++z) {
+          for (int y = 0; y < n; ++y) {
+            for (int x = 0; x < n; ++x)
+              chunk.set_voxel(x, y, z, terrain(cx * n + x, cy * n + y, cz * n + z));
+          }
+        }
+        chunk.compact();
+        world.insert({Location{cx, cy, cz}, std::move(chunk)});
+      }
+    }
+  }
+  return world;
+}
+
+// Sections around the origin with the landcover repeated in each, and
+// elevations that vary a little from section to section
+static SectionMap make_sections(
+  int radius, int elevation, const std::vector<common::LandCover>& landcover) {
+  SectionMap sections;
+  for (int z = -radius; z <= radius; ++z) {
+    for (int x = -radius; x <= radius; ++x) {
+      Location2D loc{x, z};
+      sections.insert({loc, std::make_shared<Section>(loc, elevation + static_cast<int>(hash(x, 0, z) % 8), landcover)});
+    }
+  }
+  return sections;
+}
+
+static World generate_world(WorldGenerator& generator, const std::vector<common::LandCover>& landcover) {
+  auto sections = make_sections(3, Chunk::sz_y + 8, landcover);
+  World world;
+  for (int cz = -1; cz <= 1; ++cz) {
+    for (int cy = 0; cy <= 2; ++cy) {
+      for (int cx = -1; cx <= 1; ++cx) {
+        Chunk chunk(cx, cy, cz);
+        generator.fill_chunk(chunk, sections);
+        chunk.compact();
+        world.insert({Location{cx, cy, cz}, std::move(chunk)});
+      }
+    }
+  }
+  return world;
+}
+
+// Loads every chunk of a client database
+static World load_world(const std::string& path) {
+  World world;
+  sqlite3* db;
+  if (sqlite3_open_v2(path.c_str(), &db, SQLITE_OPEN_READONLY, nullptr)) {
+    std::cerr << "Failed to open database: " << sqlite3_errmsg(db) << std::endl;
+    sqlite3_close(db);
+    return world;
+  }
+  sqlite3_stmt* stmt;
+  sqlite3_prepare_v2(db, "select x, y, z, data from Chunk", -1, &stmt, nullptr);
+  while (sqlite3_step(stmt) == SQLITE_ROW) {
+    Location loc{sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2)};
+    auto data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 3));
+    world.insert({loc, Chunk(loc, data, sqlite3_column_bytes(stmt, 3))});
+  }
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return world;
+}
+
+// Up to max_cases non-uniform recorded chunks with all their neighbours recorded
+static std::vector<Location> pick_recorded(const World& world, std::size_t max_cases) {
+  std::vector<Location> locations;
+  for (auto& [loc, chunk] : world) {
+    if (chunk.is_uniform())
+      continue;
+    auto adjacent = LocationMath::get_adjacent_locations(loc);
+    if (std::all_of(adjacent.begin(), adjacent.end(), [&world](const Location& l) { return world.contains(l); }))
+      locations.push_back(loc);
+  }
+  std::sort(locations.begin(), locations.end(), [](const Location& a, const Location& b) {
+    return std::tie(a[0], a[1], a[2]) < std::tie(b[0], b[1], b[2]);
+  });
+  if (locations.size() > max_cases)
+    locations.resize(max_cases);
+  return locations;
+}
+
+static MeshGenerator::ChunkSnapshot make_snapshot(const World& world, const Location& loc) {
+  constexpr int n = Chunk::sz_x;
+  MeshGenerator::ChunkSnapshot snapshot{loc, world.at(loc)};
+  auto adjacent = LocationMath::get_adjacent_locations(loc);
+  for (int d = 0; d < 6; ++d) {
+    auto it = world.find(adjacent[d]);
+    for (int b = 0; b < n; ++b) {
+      for (int a = 0; a < n; ++a) {
+        int i = a + n * b;
+        if (it == world.end()) {
+          snapshot.borders[d][i] = Voxel::empty;
+          continue;
+        }
+        auto& chunk = it->second;
+        snapshot.borders[d][i] = d == nx   ? chunk.get_voxel(n - 1, a, b)
+                                 : d == px ? chunk.get_voxel(0, a, b)
+                                 : d == ny ? chunk.get_voxel(a, n - 1, b)
+                                 : d == py ? chunk.get_voxel(a, 0, b)
+                                 : d == nz ? chunk.get_voxel(a, b, n - 1)
+                                           : chunk.get_voxel(a, b, 0);
+      }
+    }
+  }
+  snapshot.enclosed = false;
+  return snapshot;
+}
+
+static std::size_t count_faces(const MeshGenerator::MeshResult& result) {
+  std::size_t faces = 0;
+  for (auto& slab_mesh : result.slab_meshes)
+    faces += slab_mesh.mesh.size();
+  return faces;
+}
+
+static std::size_t count_vertices(const MeshGenerator::MeshResult& result) {
+  std::size_t vertices = 0;
+  for (auto& slab_mesh : result.slab_meshes)
+    vertices += 6 * slab_mesh.mesh.size() + slab_mesh.irregular_mesh.size() + slab_mesh.water_mesh.size();
+  return vertices;
+}
+
+// Counts the faces and hands the vectors back for the next pass, like the
+// renderer does after uploading
+static std::size_t recycle(MeshGenerator::MeshResult&& result) {
+  auto faces = count_faces(result);
+  for (auto& slab_mesh : result.slab_meshes)
+    MeshGenerator::recycle(std::move(slab_mesh));
+  return faces;
+}
+
+static bool same_mesh(const MeshGenerator::MeshResult& a, const MeshGenerator::MeshResult& b) {
+  for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+    auto& sa = a.slab_meshes[slab];
+    auto& sb = b.slab_meshes[slab];
+    if (sa.mesh.size() != sb.mesh.size() || sa.irregular_mesh.size() != sb.irregular_mesh.size() || sa.water_mesh.size() != sb.water_mesh.size())
+      return false;
+    for (std::size_t i = 0; i < sa.mesh.size(); ++i) {
+      if (sa.mesh[i].data != sb.mesh[i].data)
+        return false;
+    }
+  }
+  return true;
+}
+
+static double time_mesher(const MeshGenerator::ChunkSnapshot& snapshot, bool bitmask, int iterations) {
+  MeshGenerator::bitmask_meshing = bitmask;
+  return time_ns(iterations, [&] { sink = recycle(MeshGenerator::mesh_chunk(snapshot)); }) / Chunk::sz;
+}
+
+// Average microseconds to remesh the given slabs of a chunk
+static double time_remesh(const MeshGenerator::ChunkSnapshot& snapshot, std::uint32_t slabs, int iterations) {
+  return time_ns(iterations, [&] { sink = recycle(MeshGenerator::mesh_chunk(snapshot, slabs)); }) / 1000;
+}
+
+// Chunks as they were saved before Chunk::encode, 32 bit runs of a voxel and
+// a length with z fastest, then x, then y
+static std::vector<unsigned char> encode_legacy(const Chunk& chunk) {
+  std::vector<std::uint32_t> runs;
+  auto last_voxel = chunk.get_voxel(0, 0, 0);
+  std::uint32_t run_length = 0;
+  for (int y = 0; y < Chunk::sz_y; ++y) {
+    for (int x = 0; x < Chunk::sz_x; ++x) {
+      for (int z = 0; z < Chunk::sz_z; ++z) {
+        auto voxel = chunk.get_voxel(x, y, z);
+        if (voxel == last_voxel) {
+          ++run_length;
+        } else {
+          runs.push_back((static_cast<std::uint32_t>(last_voxel) << 16) | run_length);
+          last_voxel = voxel;
+          run_length = 1;
+        }
+      }
+    }
+  }
+  runs.push_back((static_cast<std::uint32_t>(last_voxel) << 16) | run_length);
+  auto* bytes = reinterpret_cast<const unsigned char*>(runs.data());
+  return std::vector<unsigned char>(bytes, bytes + sizeof(std::uint32_t) * runs.size());
+}
+
+// Meshes the case's chunk at every lod level, returning ns per voxel and the
+// vertex count for each. The centre is moved so the chunk and its neighbours
+// all fall in the ring of the level being meshed.
+static std::array<std::pair<double, std::size_t>, 4> time_lod_mesher(const Case& c, int iterations) {
+  constexpr std::array<int, 4> offsets = {6, 11, 15, 21};
+  LodLoader lod_loader;
+  for (auto& [loc, chunk] : c.world)
+    lod_loader.create_lods(chunk);
+  std::array<std::pair<double, std::size_t>, 4> results;
+  auto time_level = [&]<LodLevel level>() {
+    int i = static_cast<int>(level);
+    lod_loader.set_center(Location{c.location[0] + offsets[i], c.location[1], c.location[2]});
+    std::size_t vertices = 0;
+    double ns = time_ns(iterations, [&] {
+      auto mesh = LodMeshGenerator::mesh_chunk<level>(lod_loader, c.location);
+      vertices = mesh.size();
+      sink = vertices;
+    });
+    results[i] = {ns / Chunk::sz, vertices};
+  };
+  time_level.template operator()<LodLevel::lod1>();
+  time_level.template operator()<LodLevel::lod2>();
+  time_level.template operator()<LodLevel::lod3>();
+  time_level.template operator()<LodLevel::lod4>();
+  return results;
+}
+
+// Builds every level of the heightfield from scratch out of hilly sections,
+// returning microseconds per build, the vertex count and the sections used
+static std::tuple<double, std::size_t, std::size_t> time_heightfield(int iterations) {
+  std::vector<std::shared_ptr<Section>> sections;
+  {
+    HeightfieldClipmap heightfield;
+    heightfield.set_center(Location2D{0, 0});
+    std::vector<common::LandCover> landcover = {common::LandCover::grass, common::LandCover::grass, common::LandCover::trees, common::LandCover::bare};
+    for (auto& loc : heightfield.get_missing_samples()) {
+      int elevation = 64 + 48 * std::sin(loc[0] * .05) * std::cos(loc[1] * .04);
+      sections.push_back(std::make_shared<Section>(loc, elevation, landcover));
+    }
+  }
+  std::size_t vertices = 0;
+  double ns = time_ns(iterations, [&] {
+    HeightfieldClipmap heightfield;
+    heightfield.set_center(Location2D{0, 0});
+    for (auto& section : sections)
+      heightfield.add_sample(*section);
+    heightfield.update();
+    vertices = 0;
+    for (auto& level_mesh : heightfield.get_meshes())
+      vertices += level_mesh.mesh.size();
+    sink = vertices;
+  });
+  return {ns / 1000, vertices, sections.size()};
+}
+
+// Stores a 16x4x16 block of chunks, cycling through the blobs of the given
+// chunks, then loads them back nearest first from a freshly opened store.
+// Returns microseconds per chunk to store and to load.
+static std::pair<double, double> time_store(ChunkStore::Backend backend, const std::vector<const Chunk*>& chunks) {
+  auto dir = std::filesystem::temp_directory_path() / "csworld_bench";
+  std::filesystem::remove_all(dir);
+  std::filesystem::create_directories(dir);
+  std::vector<std::vector<unsigned char>> blobs;
+  for (auto* chunk : chunks)
+    blobs.push_back(chunk->encode());
+  ChunkStore::Batch batch;
+  std::vector<Location> locs;
+  for (int z = -8; z < 8; ++z) {
+    for (int y = -2; y < 2; ++y) {
+      for (int x = -8; x < 8; ++x) {
+        locs.push_back({x, y, z});
+        batch[locs.back()] = blobs[locs.size() % blobs.size()];
+      }
+    }
+  }
+  std::ranges::sort(locs, {}, [](const Location& loc) { return LocationMath::distance(loc, Location{0, 0, 0}); });
+
+  double store_ns = time_ns(1, [&] { ChunkStore::create(backend, dir.string())->store(batch); });
+  auto store = ChunkStore::create(backend, dir.string());
+  double load_ns = time_ns(1, [&] {
+    for (auto& loc : locs)
+      sink = store->load(loc)->index();
+  });
+  store.reset();
+  std::filesystem::remove_all(dir);
+  return {store_ns / 1000 / locs.size(), load_ns / 1000 / locs.size()};
+}
+
+// Fills a column of chunks from freshly made sections, so the cost of
+// smoothing their elevations and placing their features is included
+static double time_fill_chunk(WorldGenerator& generator, const std::vector<common::LandCover>& landcover, int iterations) {
+  constexpr int column_height = 4;
+  double ns = time_ns(iterations, [&] {
+    auto sections = make_sections(2, Chunk::sz_y + 8, landcover);
+    for (int y = 0; y < column_height; ++y) {
+      Chunk chunk(0, y, 0);
+      generator.fill_chunk(chunk, sections);
+      sink = chunk.is_uniform();
+    }
+  });
+  return ns / (column_height * Chunk::sz);
+}
+
+// Fills an 8x8 block of columns of chunks from freshly made sections, first on
+// this thread and then across the job system's workers the way streaming does,
+// from a second generator as another run would. Returns chunks per second each
+// way and whether both gave the same voxels.
+static std::tuple<double, double, bool> time_generation(WorldGenerator& generator, const std::vector<common::LandCover>& landcover) {
+  std::vector<Location> locs;
+  for (int z = -4; z < 4; ++z) {
+    for (int x = -4; x < 4; ++x) {
+      for (int y = 0; y < 4; ++y)
+        locs.push_back({x, y, z});
+    }
+  }
+
+  World serial;
+  double serial_ns = time_ns(1, [&] {
+    auto sections = make_sections(6, Chunk::sz_y + 8, landcover);
+    for (auto& loc : locs) {
+      Chunk chunk(loc[0], loc[1], loc[2]);
+      generator.fill_chunk(chunk, sections);
+      serial.insert({loc, std::move(chunk)});
+    }
+  });
+
+  World parallel;
+  WorldGenerator other;
+  CompletionQueue<std::optional<Chunk>> generated;
+  double parallel_ns = time_ns(1, [&] {
+    auto sections = make_sections(6, Chunk::sz_y + 8, landcover);
+    for (auto& loc : locs) {
+      auto to_fill = std::make_shared<const SectionMap>(other.get_sections_to_fill(loc, sections));
+      JobSystem::instance()->submit([&other, &generated, loc, to_fill](int worker) {
+        Chunk chunk(loc[0], loc[1], loc[2]);
+        other.fill_chunk(chunk, *to_fill);
+        generated.push(worker, std::move(chunk));
+      });
+    }
+    std::optional<Chunk> chunk;
+    while (parallel.size() < locs.size()) {
+      if (!generated.try_pop(chunk)) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto loc = chunk->get_location();
+      parallel.insert({loc, std::move(*chunk)});
+    }
+  });
+
+  bool same = true;
+  for (auto& loc : locs)
+    same = same && serial.at(loc).get_voxels() == parallel.at(loc).get_voxels();
+  return {locs.size() * 1e9 / serial_ns, locs.size() * 1e9 / parallel_ns, same};
+}
+
+static std::string pad(const std::string& s, std::size_t width) {
+  return s.size() < width ? s + std::string(width - s.size(), ' ') : s + ' ';
+}
+
+int main(int argc, char* argv[]) {
+  int iterations = 200;
+  std::string db_path, json_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--db" && i + 1 < argc)
+      db_path = argv[++i];
+    else if (arg == "--json" && i + 1 < argc)
+      json_path = argv[++i];
+    else
+      iterations = std::stoi(arg);
+  }
+
+  using common::LandCover;
+  WorldGenerator generator;
+  std::vector<Case> cases = {
+    {"flat", make_world([](int x, int y, int z) {
+       return y < 16 ? Voxel::dirt : Voxel::empty;
+     }),
+     Location{0, 0, 0}},
+    {"hills", make_world([](int x, int y, int z) {
+       int height = 16 + static_cast<int>(8 * std::sin(x / 6.0) * std::cos(z / 9.0));
+       if (y < height - 3)
+         return Voxel::stone;
+       if (y < height)
+         return Voxel::dirt;
+       if (y == height && hash(x, y, z) % 8 == 0)
+         return Voxel::grass;
+       if (y < 14)
+         return Voxel::water_full;
+       return Voxel::empty;
+     }),
+     Location{0, 0, 0}},
+    {"caves", make_world([](int x, int y, int z) {
+       double d = std::sin(x * 0.3) + std::sin(y * 0.35) + std::sin(z * 0.4);
+       return d > 1.2 ? Voxel::empty : Voxel::stone;
+     }),
+     Location{0, 0, 0}},
+    {"forest", generate_world(generator, {LandCover::trees, LandCover::trees, LandCover::trees, LandCover::grass}),
+     Location{0, 1, 0}},
+    {"checkerboard", make_world([](int x, int y, int z) {
+       return (x + y + z) & 1 ? Voxel::stone : Voxel::empty;
+     }),
+     Location{0, 0, 0}},
+  };
+  if (!db_path.empty()) {
+    auto recorded = load_world(db_path);
+    for (auto& loc : pick_recorded(recorded, 4))
+      cases.push_back({"db " + std::to_string(loc[0]) + "," + std::to_string(loc[1]) + "," + std::to_string(loc[2]), recorded, loc});
+  }
+
+  nlohmann::json results;
+  results["iterations"] = iterations;
+  bool greedy = MeshGenerator::greedy_meshing;
+
+  std::cout << "mesh          faces  vertices  bytes   voxel ns/voxel  bitmask ns/voxel  speedup\n";
+  for (auto& c : cases) {
+    auto snapshot = make_snapshot(c.world, c.location);
+
+    MeshGenerator::greedy_meshing = false;
+    MeshGenerator::bitmask_meshing = false;
+    auto reference = MeshGenerator::mesh_chunk(snapshot);
+    MeshGenerator::bitmask_meshing = true;
+    auto result = MeshGenerator::mesh_chunk(snapshot);
+    if (!same_mesh(reference, result)) {
+      std::cout << c.name << ": bitmask mesher output differs\n";
+      return 1;
+    }
+
+    double voxel_ns = time_mesher(snapshot, false, iterations);
+    double bitmask_ns = time_mesher(snapshot, true, iterations);
+    auto faces = count_faces(reference);
+    auto vertices = count_vertices(reference);
+    auto bytes = snapshot.chunk.get_memory_usage();
+    std::cout << pad(c.name, 14) << pad(std::to_string(faces), 7) << pad(std::to_string(vertices), 10)
+              << pad(std::to_string(bytes), 8) << pad(std::to_string(voxel_ns), 16) << pad(std::to_string(bitmask_ns), 18)
+              << voxel_ns / bitmask_ns << "x\n";
+    results["mesh"].push_back({{"case", c.name},
+                               {"faces", faces},
+                               {"vertices", vertices},
+                               {"chunk_bytes", bytes},
+                               {"voxel_ns_per_voxel", voxel_ns},
+                               {"bitmask_ns_per_voxel", bitmask_ns}});
+  }
+
+  // an edit in the middle of a slab only remeshes that slab
+  MeshGenerator::greedy_meshing = greedy;
+  MeshGenerator::bitmask_meshing = true;
+  auto snapshot = make_snapshot(cases[1].world, cases[1].location);
+  double chunk_us = time_remesh(snapshot, Chunk::all_slabs, iterations);
+  double slab_us = time_remesh(snapshot, Chunk::get_slabs_around(Chunk::slab_sz_y / 2), iterations);
+  std::cout << "\nremesh hills chunk: " << chunk_us << " us, one slab: " << slab_us << " us\n";
+  results["remesh"] = {{"case", cases[1].name}, {"chunk_us", chunk_us}, {"slab_us", slab_us}};
+
+  std::cout << "\ncodec         bytes  legacy bytes  encode ns/voxel  decode ns/voxel  legacy decode ns/voxel  speedup\n";
+  for (auto& c : cases) {
+    auto& chunk = c.world.at(c.location);
+    auto blob = chunk.encode();
+    auto legacy = encode_legacy(chunk);
+    auto voxels = chunk.get_voxels();
+    if (Chunk(c.location, blob.data(), blob.size()).get_voxels() != voxels ||
+        Chunk(c.location, legacy.data(), legacy.size()).get_voxels() != voxels) {
+      std::cout << c.name << ": chunk codec round trip differs\n";
+      return 1;
+    }
+    double encode_ns = time_ns(iterations, [&] { sink = chunk.encode().size(); }) / Chunk::sz;
+    auto time_decode = [&](const std::vector<unsigned char>& data) {
+      return time_ns(iterations, [&] {
+        Chunk decoded(c.location, data.data(), data.size());
+        sink = static_cast<std::size_t>(decoded.get_voxel(0));
+      }) / Chunk::sz;
+    };
+    double decode_ns = time_decode(blob);
+    double legacy_ns = time_decode(legacy);
+    std::cout << pad(c.name, 14) << pad(std::to_string(blob.size()), 7) << pad(std::to_string(legacy.size()), 14)
+              << pad(std::to_string(encode_ns), 17) << pad(std::to_string(decode_ns), 17)
+              << pad(std::to_string(legacy_ns), 24) << legacy_ns / decode_ns << "x\n";
+    results["codec"].push_back({{"case", c.name},
+                                {"bytes", blob.size()},
+                                {"legacy_bytes", legacy.size()},
+                                {"encode_ns_per_voxel", encode_ns},
+                                {"decode_ns_per_voxel", decode_ns},
+                                {"legacy_decode_ns_per_voxel", legacy_ns}});
+  }
+
+  // a player building a 4x4x4 block in the forest, saved as an edit log
+  auto& generated = cases[3].world.at(cases[3].location);
+  Chunk edited = generated;
+  for (int z = 0; z < 4; ++z) {
+    for (int y = 0; y < 4; ++y) {
+      for (int x = 0; x < 4; ++x)
+        edited.set_voxel(12 + x, 12 + y, 12 + z, Voxel::stone);
+    }
+  }
+  auto edit_log = ChunkEdits::diff(edited, generated)->encode();
+  Chunk replayed = generated;
+  ChunkEdits(cases[3].location, edit_log.data(), edit_log.size()).apply(replayed);
+  if (replayed.get_voxels() != edited.get_voxels()) {
+    std::cout << "edit log replay differs\n";
+    return 1;
+  }
+  double diff_us = time_ns(iterations, [&] { sink = ChunkEdits::diff(edited, generated)->size(); }) / 1000;
+  auto snapshot_bytes = edited.encode().size();
+  std::cout << "\nedit log " << cases[3].name << ": " << edit_log.size() << " bytes against " << snapshot_bytes
+            << " for the whole chunk, " << diff_us << " us to diff\n";
+  results["edit_log"] = {{"case", cases[3].name}, {"bytes", edit_log.size()}, {"snapshot_bytes", snapshot_bytes}, {"diff_us", diff_us}};
+
+  // a block built in the sky, saved as an edit log and loaded back, has to be meshed
+  {
+    auto sections = make_sections(3, Chunk::sz_y + 8, {LandCover::grass, LandCover::grass, LandCover::grass, LandCover::grass});
+    auto generate = [&](const Location& loc) {
+      Chunk chunk(loc[0], loc[1], loc[2]);
+      generator.fill_chunk(chunk, sections);
+      return chunk;
+    };
+    Location sky{0, 3, 0};
+    Chunk built = generate(sky);
+    built.set_voxel(16, 0, 16, Voxel::stone);
+    auto sky_log = ChunkEdits::diff(built, generate(sky))->encode();
+    Chunk reloaded = generate(sky);
+    ChunkEdits(sky, sky_log.data(), sky_log.size()).apply(reloaded);
+    Region region;
+    for (auto& loc : LocationMath::get_adjacent_locations(sky))
+      region.add_chunk(generate(loc));
+    region.add_chunk(std::move(reloaded));
+    bool meshed = std::ranges::any_of(region.get_diffs(), [&](const Region::Diff& diff) {
+      return diff.location == sky && diff.kind == Region::Diff::creation;
+    });
+    if (!meshed) {
+      std::cout << "edited sky chunk isn't meshed after reloading\n";
+      return 1;
+    }
+  }
+
+  // filling a box through the hills with stone, then undoing it
+  auto undo_world = cases[1].world;
+  UndoJournal journal;
+  journal.begin_update();
+  std::size_t box_voxels = 0;
+  double edit_us = time_ns(1, [&] {
+    for (int z = -32; z < 32; ++z) {
+      for (int y = 0; y < 24; ++y) {
+        for (int x = -32; x < 32; ++x) {
+          Location loc{x >> 5, y >> 5, z >> 5};
+          auto& chunk = undo_world.at(loc);
+          int i = Chunk::get_index(x & 31, y & 31, z & 31);
+          journal.record(loc, i, chunk.get_voxel(i));
+          chunk.set_voxel(i, Voxel::stone);
+          ++box_voxels;
+        }
+      }
+    }
+  }) / 1000;
+  // starting the next update closes this one into runs
+  journal.begin_update();
+  auto undo_bytes = journal.get_memory_usage();
+  journal.pop_update();
+  auto update = journal.pop_update();
+  double undo_us = time_ns(1, [&] {
+    for (auto& delta : *update) {
+      auto& chunk = undo_world.at(delta.location);
+      UndoJournal::for_each_run(delta, [&](int i, int count, Voxel voxel) { chunk.set_voxels(i, count, voxel); });
+    }
+  }) / 1000;
+  for (auto& [loc, chunk] : undo_world) {
+    if (chunk.get_voxels() != cases[1].world.at(loc).get_voxels()) {
+      std::cout << "undo differs\n";
+      return 1;
+    }
+  }
+  // the journal before kept 16 bytes for every voxel edited
+  std::cout << "\nundo " << box_voxels << " voxel box: " << undo_bytes << " bytes against " << box_voxels * 16
+            << " before, " << edit_us << " us to edit, " << undo_us << " us to undo\n";
+  results["undo"] = {{"voxels", box_voxels}, {"bytes", undo_bytes}, {"edit_us", edit_us}, {"undo_us", undo_us}};
+
+  std::vector<const Chunk*> chunks;
+  for (auto& c : cases) {
+    // its decode would swamp the difference between backends
+    if (c.name != "checkerboard")
+      chunks.push_back(&c.world.at(c.location));
+  }
+  std::cout << "\nstore         store us/chunk  load us/chunk\n";
+  for (auto& [name, backend] : {std::pair{"sqlite", ChunkStore::Backend::sqlite}, {"regions", ChunkStore::Backend::region_files}}) {
+    auto [store_us, load_us] = time_store(backend, chunks);
+    std::cout << pad(name, 14) << pad(std::to_string(store_us), 16) << load_us << "\n";
+    results["store"].push_back({{"backend", name}, {"store_us_per_chunk", store_us}, {"load_us_per_chunk", load_us}});
+  }
+
+  std::cout << "\nlod           lod1 verts  lod2 verts  lod3 verts  lod4 verts  mesh ns/voxel  cascade ns/voxel\n";
+  for (auto& c : cases) {
+    auto levels = time_lod_mesher(c, iterations);
+    auto& chunk = c.world.at(c.location);
+    // downsamples the chunk through all four levels
+    double cascade_ns = time_ns(iterations, [&] {
+      LodLoader lod_loader;
+      lod_loader.create_lods(chunk);
+      sink = lod_loader.has_lods(c.location);
+    }) / Chunk::sz;
+    double mesh_ns = 0;
+    std::cout << pad(c.name, 14);
+    for (auto& [ns, vertices] : levels) {
+      mesh_ns += ns;
+      std::cout << pad(std::to_string(vertices), 12);
+    }
+    std::cout << pad(std::to_string(mesh_ns), 15) << cascade_ns << "\n";
+    nlohmann::json entry = {{"case", c.name}, {"mesh_ns_per_voxel", mesh_ns}, {"cascade_ns_per_voxel", cascade_ns}};
+    for (std::size_t i = 0; i < levels.size(); ++i) {
+      entry["lod" + std::to_string(i + 1) + "_vertices"] = levels[i].second;
+      entry["lod" + std::to_string(i + 1) + "_mesh_ns_per_voxel"] = levels[i].first;
+    }
+    results["lod"].push_back(entry);
+  }
+
+  auto [heightfield_us, heightfield_vertices, heightfield_sections] = time_heightfield(iterations);
+  std::cout << "\nheightfield: " << heightfield_vertices << " vertices from " << heightfield_sections
+            << " sections, " << heightfield_us << " us to build every level\n";
+  results["heightfield"] = {{"vertices", heightfield_vertices}, {"sections", heightfield_sections}, {"build_us", heightfield_us}};
+
+  std::vector<std::pair<std::string, std::vector<LandCover>>> landcovers = {
+    {"bare", {LandCover::bare, LandCover::bare, LandCover::bare, LandCover::bare}},
+    {"grass", {LandCover::grass, LandCover::grass, LandCover::grass, LandCover::grass}},
+    {"forest", {LandCover::trees, LandCover::trees, LandCover::trees, LandCover::trees}},
+    {"mixed", {LandCover::trees, LandCover::grass, LandCover::water, LandCover::bare}},
+  };
+  std::cout << "\nfill_chunk    ns/voxel\n";
+  for (auto& [name, landcover] : landcovers) {
+    double ns = time_fill_chunk(generator, landcover, iterations);
+    std::cout << pad(name, 14) << ns << "\n";
+    results["fill_chunk"].push_back({{"landcover", name}, {"ns_per_voxel", ns}});
+  }
+
+  // the three feature noise fields of a section, column by column and a grid at a time
+  WorldGenerator::NoiseGenerator noise_gen;
+  open_simplex_noise(7, &noise_gen.ctx);
+  std::array<WorldGenerator::NoiseGenerator::Grid, 3> scalar_noise, grid_noise;
+  double scalar_noise_us = time_ns(iterations, [&] {
+    for (int i = 0; i < 3; ++i) {
+      for (int z = 0; z < Section::sz_z; ++z) {
+        for (int x = 0; x < Section::sz_x; ++x)
+          scalar_noise[i][x + Section::sz_x * z] = noise_gen.noise(x, z, 4096 * i);
+      }
+    }
+  }) / 1000;
+  double grid_noise_us = time_ns(iterations, [&] {
+    for (int i = 0; i < 3; ++i)
+      grid_noise[i] = noise_gen.noise_grid(0, 0, 4096 * i);
+  }) / 1000;
+  open_simplex_noise_free(noise_gen.ctx);
+  if (scalar_noise != grid_noise) {
+    std::cout << "noise grid differs\n";
+    return 1;
+  }
+  std::cout << "\nfeature noise: " << scalar_noise_us << " us per section column by column, " << grid_noise_us
+            << " us as grids, cached once per generator now\n";
+  results["feature_noise"] = {{"scalar_us", scalar_noise_us}, {"grid_us", grid_noise_us}};
+
+  // trees are seeded by where they stand, so both ways must agree
+  auto [serial_rate, parallel_rate, same] = time_generation(generator, landcovers[2].second);
+  if (!same) {
+    std::cout << "generation on the workers differs\n";
+    return 1;
+  }
+  int workers = JobSystem::instance()->get_num_workers();
+  std::cout << "\ngeneration: " << serial_rate << " chunks/s on one thread, " << parallel_rate << " chunks/s on "
+            << workers << " workers\n";
+  results["generation"] = {{"workers", workers}, {"serial_chunks_per_s", serial_rate}, {"parallel_chunks_per_s", parallel_rate}};
+
+  if (!json_path.empty()) {
+    std::ofstream out(json_path);
+    out << results.dump(2) << "\n";
+  }
+}
@@ -0,0 +1,53 @@
+// Vertex pulling for cube faces, every face in faces[] is drawn as six
+// vertices and gl_VertexID / 6 picks the face
+layout (binding = 2, std430) readonly buffer FaceBuffer {
+    uint faces[];
+};
+
+const uint faceXMask = 0x0000001F;
+const uint faceYMask = 0x000003E0;
+const uint faceZMask = 0x00007C00;
+const uint faceNormalMask = 0x00038000;
+const uint faceWidthMask = 0x003C0000;
+const uint faceHeightMask = 0x03C00000;
+const uint faceTextureMask = 0xFC000000;
+
+// Corners of the two triangles along the face's width and height, swapped for
+// the px, ny and pz faces so every face winds the same way seen from outside
+const ivec2 faceCorners[6] = {
+    ivec2(0, 0),
+    ivec2(1, 1),
+    ivec2(1, 0),
+    ivec2(0, 0),
+    ivec2(0, 1),
+    ivec2(1, 1)
+};
+
+struct CubeFaceVertex {
+    vec3 local;
+    int normalId;
+    uint textureId;
+};
+
+CubeFaceVertex pullCubeFaceVertex() {
+    uint face = faces[gl_VertexID / 6];
+    ivec2 corner = faceCorners[gl_VertexID % 6];
+
+    CubeFaceVertex v;
+    v.normalId = int((face & faceNormalMask) >> 15);
+    v.textureId = (face & faceTextureMask) >> 26;
+    if (v.normalId == 1 || v.normalId == 2 || v.normalId == 5)
+        corner = corner.yx;
+
+    ivec3 local = ivec3(face & faceXMask, (face & faceYMask) >> 5, (face & faceZMask) >> 10);
+    int width = int((face & faceWidthMask) >> 18) + 1;
+    int height = int((face & faceHeightMask) >> 22) + 1;
+    int normalAxis = v.normalId / 2;
+    int a = normalAxis == 0 ? 1 : 0;
+    int b = normalAxis == 2 ? 1 : 2;
+    local[normalAxis] += v.normalId & 1;
+    local[a] += corner.x * width;
+    local[b] += corner.y * height;
+    v.local = vec3(local);
+    return v;
+}
@@ -0,0 +1,19 @@
+#version 460 core
+
+#include <shadow.glsl>
+
+in vec3 fragColor;
+in vec3 fragWorldNormal;
+in vec3 fragCameraNormal;
+
+layout (location=0) out vec4 gColor;
+layout (location=1) out vec4 gNormal;
+
+// Like lods the heightfield isn't in the shadow map, so slopes turned from the
+// sun are shaded like shadowed terrain, softened near the terminator
+void main() {
+  vec3 normal = normalize(fragWorldNormal);
+  float shadow = shadowMagnitude * (1.0 - smoothstep(0.0, 0.2, dot(normal, lightDir)));
+  gColor = vec4((1-shadow) * fragColor, 1.f);
+  gNormal = vec4(normalize(fragCameraNormal), 1.f);
+}
@@ -0,0 +1,22 @@
+#version 460 core
+
+#include <common.glsl>
+
+layout (location = 0) in vec3 position;
+layout (location = 1) in vec3 normal;
+layout (location = 2) in vec3 color;
+
+uniform mat4 uTransform;
+// centre of the clipmap level relative to the render origin
+uniform vec3 uOffset;
+
+out vec3 fragColor;
+out vec3 fragWorldNormal;
+out vec3 fragCameraNormal;
+
+void main() {
+    gl_Position = uTransform * vec4(position + uOffset, 1.f);
+    fragColor = color;
+    fragWorldNormal = normal;
+    fragCameraNormal = (normalMatrix*vec4(normal,0.f)).xyz;
+}
@@ -1,14 +1,24 @@
 #version 460 core
 
+#include <shadow.glsl>
+
 uniform sampler2DArray textureArray;
 
 in vec2 fragUvs;
+in vec3 fragWorldNormal;
+in vec3 fragCameraNormal;
 flat in uint fragTextureId;
 
-out vec4 color;
+layout (location=0) out vec4 gColor;
+layout (location=1) out vec4 gNormal;
 
+// Lods aren't drawn into the shadow map, so only faces turned from the sun
+// are shaded like shadowed terrain
 void main() {
-  color = texture(textureArray, vec3(fragUvs, fragTextureId));
-  if (color.a == 0.0)
+  vec4 textureColor = texture(textureArray, vec3(fragUvs, fragTextureId));
+  if (textureColor.a == 0.0)
     discard;
-}
\ No newline at end of file
+  float shadow = dot(fragWorldNormal, lightDir) <= 0 ? shadowMagnitude : 0.0;
+  gColor = vec4((1-shadow) * textureColor.rgb, 1.f);
+  gNormal = vec4(fragCameraNormal, 1.f);
+}
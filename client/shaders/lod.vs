@@ -1,42 +1,51 @@
 #version 460 core
 
+#include <common.glsl>
+
 layout (location = 0) in uint data;
 layout (binding = 1, std430) readonly buffer ssbo {
     vec3 chunkPos[];
 };
 
 uniform mat4 uTransform;
-uniform float uHorizontalScale;
+// chunk voxels per lod voxel
+uniform float uScale;
 
 out vec2 fragUvs;
+out vec3 fragWorldNormal;
+out vec3 fragCameraNormal;
 flat out uint fragTextureId;
 
-const uint xpos_mask = 0x0000000F;
-const uint ypos_mask = 0x000001F0;
-const uint zpos_mask = 0x00001E00;
-const uint normal_mask = 0x0000E000;
-const uint uvs_mask = 0x00030000;
-const uint texture_mask = 0xFFFC0000;
+const uint xpos_mask = 0x0000001F;
+const uint ypos_mask = 0x000003E0;
+const uint zpos_mask = 0x00007C00;
+const uint normal_mask = 0x00038000;
+const uint uvs_mask = 0x000C0000;
+const uint texture_mask = 0xFFF00000;
 const vec2 uvs[4] = {
     vec2(0.0, 0.0),
     vec2(1.0, 0.0),
     vec2(0.0, 1.0),
     vec2(1.0, 1.0)
 };
+const vec3 normals[6] = {
+    vec3(-1.f,0.f,0.f),
+    vec3(1.f,0.f,0.f),
+    vec3(0.f,-1.f,0.f),
+    vec3(0.f,1.f,0.f),
+    vec3(0.f,0.f,-1.f),
+    vec3(0.f,0.f,1.f)
+};
 
 void main() {
-    vec3 pos;
-    vec3 loc = chunkPos[gl_DrawID];
-    pos.x = uHorizontalScale*(data & xpos_mask) + loc.x;
-    pos.y = ((data & ypos_mask) >> 4) + loc.y;
-    pos.z = uHorizontalScale*((data & zpos_mask) >> 9) + loc.z;
-    gl_Position = uTransform * vec4(pos,1.f);    
-
-    int normal = int((data & normal_mask) >> 13);
-    int uvsId = int((data & uvs_mask) >> 16);
-    uint textureId = uint((data & texture_mask) >> 18);
+    vec3 local = vec3(data & xpos_mask, (data & ypos_mask) >> 5, (data & zpos_mask) >> 10);
+    vec3 pos = uScale * local + chunkPos[gl_DrawID];
+    gl_Position = uTransform * vec4(pos,1.f);
 
-    fragTextureId = textureId;
-    vec2 texcoords = uvs[uvsId];
-    fragUvs = vec2(texcoords);
-}
\ No newline at end of file
+    int normal = int((data & normal_mask) >> 15);
+    int uvsId = int((data & uvs_mask) >> 18);
+    fragTextureId = (data & texture_mask) >> 20;
+    fragUvs = uvs[uvsId];
+    fragWorldNormal = normals[normal];
+    fragCameraNormal = (normalMatrix*vec4(normals[normal],0.f)).xyz;
+}
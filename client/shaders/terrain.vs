@@ -1,8 +1,8 @@
 #version 460 core
 
 #include <common.glsl>
+#include <cube_face.glsl>
 
-layout (location = 0) in uint data;
 layout (binding = 1, std430) readonly buffer ssbo {
     vec3 chunkPos[];
 };
@@ -19,18 +19,6 @@ flat out uint fragTextureId;
 uniform mat4 uView;
 uniform mat4 uTransform; // should be in UBO
 
-const uint xposMask = 0x0000003F;
-const uint yposMask = 0x00000FC0;
-const uint zposMask = 0x0003F000;
-const uint normalMask = 0x001C0000;
-const uint uvsMask = 0x00600000;
-const uint textureMask = 0xFF800000;
-const vec2 uvs[4] = {
-    vec2(0.0, 0.0),
-    vec2(1.0, 0.0),
-    vec2(0.0, 1.0),
-    vec2(1.0, 1.0)
-};
 const vec3 normals[6] = {
     vec3(-1.f,0.f,0.f),
     vec3(1.f,0.f,0.f),
@@ -40,25 +28,31 @@ const vec3 normals[6] = {
     vec3(0.f,0.f,1.f)
 };
 
+// Texture coordinates run one unit per voxel along the face so merged faces
+// repeat the texture
+vec2 faceUvs(vec3 local, int normalId) {
+    switch (normalId) {
+    case 0: return vec2(-local.z, local.y);
+    case 1: return vec2(local.z, local.y);
+    case 2: return vec2(local.x, local.z);
+    case 3: return vec2(-local.z, local.x);
+    case 4: return vec2(local.x, local.y);
+    default: return vec2(-local.x, local.y);
+    }
+}
+
 void main() {
-    vec3 pos;
-    vec3 loc = chunkPos[gl_DrawID];
-    pos.x = (data & xposMask) + loc.x;
-    pos.y = ((data & yposMask) >> 6) + loc.y;
-    pos.z = ((data & zposMask) >> 12) + loc.z;
+    CubeFaceVertex v = pullCubeFaceVertex();
+    vec3 pos = v.local + chunkPos[gl_DrawID];
 
     gl_Position = uTransform * vec4(pos,1.f);
-    
-    int normalId = int((data & normalMask) >> 18);
-    int uvsId = int((data & uvsMask) >> 21);
-    uint textureId = uint((data & textureMask) >> 23);
 
-    fragTextureId = textureId;
-    vs_out.uvs = uvs[uvsId];
+    fragTextureId = v.textureId;
+    vs_out.uvs = faceUvs(v.local, v.normalId);
     vs_out.worldPos = pos;
-    vec3 normal = normals[normalId];
+    vec3 normal = normals[v.normalId];
     vs_out.worldNormal = normal;
     vec4 cameraPos = uView * vec4(pos, 1.f);
     vs_out.cameraPos = cameraPos.xyz;
     vs_out.cameraNormal = (normalMatrix*vec4(normal,0.f)).xyz;
-}
+}
\ No newline at end of file
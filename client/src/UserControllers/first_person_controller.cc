@@ -2,6 +2,7 @@
 #include "build_controller.h"
 #include "disabled_controller.h"
 #include "input.h"
+#include "mesh_buffer_pool.h"
 #include "inventory_controller.h"
 #include "options_controller.h"
 #include "UI/cefui.h"
@@ -138,6 +139,29 @@ void FirstPersonController::process_input(const InputEvent& event) {
     } else if (key_button_event.key == GLFW_KEY_P) {
       std::cout << "Player at (" << static_cast<long long>(pos[0]) << "," << static_cast<long long>(pos[1]) << "," << static_cast<long long>(pos[2]) << ")" << std::endl;
       camera.print();
+      std::cout << "Voxel memory: " << region.get_voxel_memory_usage() / 1024 << " KiB" << std::endl;
+      std::cout << "Undo journal: " << region.get_undo_memory_usage() / 1024 << " KiB" << std::endl;
+      auto pool_stats = ChunkBufferPool::instance()->get_stats();
+      std::cout << "Chunk buffers: " << pool_stats.buffers_in_use << " in use, "
+                << pool_stats.buffers_free << " free, "
+                << pool_stats.peak_buffers_in_use << " peak, "
+                << pool_stats.slabs << " slabs (" << pool_stats.bytes_reserved / 1024 << " KiB), "
+                << pool_stats.acquires << " acquires, "
+                << pool_stats.releases << " releases" << std::endl;
+      auto mesh_pool_stats = MeshBufferPool::instance()->get_stats();
+      std::cout << "Mesh buffers: " << mesh_pool_stats.free_faces << " face and "
+                << mesh_pool_stats.free_vertices << " vertex vectors free, "
+                << mesh_pool_stats.reused << " reused, "
+                << mesh_pool_stats.allocated << " allocated" << std::endl;
+      std::cout << "Cube faces: " << mesh_generator.get_cube_face_count()
+                << ", draw " << sim_.get_average_draw_ms() << " ms"
+                << ", edit to upload " << sim_.get_renderer().get_average_edit_latency_ms() << " ms" << std::endl;
+    } else if (key_button_event.key == GLFW_KEY_G) {
+      MeshGenerator::greedy_meshing = !MeshGenerator::greedy_meshing;
+      std::cout << "Greedy meshing " << (MeshGenerator::greedy_meshing ? "on" : "off")
+                << ", cube faces before: " << mesh_generator.get_cube_face_count()
+                << ", draw " << sim_.get_average_draw_ms() << " ms" << std::endl;
+      region.remesh_all();
     } else if (key_button_event.key == GLFW_KEY_C) {
       camera.set_position(glm::dvec3{4230225.256719, 311.122231, -1220227.127904});
       camera.set_orientation(-41.5007, -12); 
@@ -21,6 +21,8 @@ namespace {
 
 WorldGenerator::WorldGenerator() {
   open_simplex_noise(7, &grass_gen_.ctx);
+  for (int i = 0; i < 3; ++i)
+    feature_noise_[i] = grass_gen_.noise_grid(0, 0, 4096 * i);
 
   tree_roots_.resize(tree_root_grid_sz_x * tree_root_grid_sz_z, false);
   cy::WeightedSampleElimination<cy::Point2d, double, 2> wse;
@@ -46,7 +48,7 @@ WorldGenerator::WorldGenerator() {
   }
 }
 
-bool WorldGenerator::ready_to_fill(Location& location, const std::unordered_map<Location2D, Section, Location2DHash>& sections) const {
+bool WorldGenerator::ready_to_fill(const Location& location, const SectionMap& sections) const {
   std::array<int, 5> arr{-2, -1, 0, 1, 2};
   for (auto x : arr) {
     for (auto z : arr) {
@@ -57,17 +59,42 @@ bool WorldGenerator::ready_to_fill(Location& location, const std::unordered_map<
   return true;
 }
 
+// Expects ready_to_fill(location, sections)
+SectionMap WorldGenerator::get_sections_to_fill(const Location& location, const SectionMap& sections) const {
+  SectionMap to_fill;
+  for (int x = -2; x <= 2; ++x) {
+    for (int z = -2; z <= 2; ++z) {
+      auto loc = Location2D{location[0] + x, location[2] + z};
+      to_fill.insert({loc, sections.at(loc)});
+    }
+  }
+  return to_fill;
+}
+
+// The nth random number drawn at a position, the same whichever thread draws
+// it and whenever, so generated terrain is the same every time
+std::uint32_t WorldGenerator::random(const Int3D& pos, std::uint32_t n) {
+  auto h = common::Hash(static_cast<std::uint32_t>(pos[0]));
+  h = common::Hash(h ^ static_cast<std::uint32_t>(pos[1]));
+  h = common::Hash(h ^ static_cast<std::uint32_t>(pos[2]));
+  return common::Hash(h ^ n);
+}
+
+int WorldGenerator::random_int(int low, int high, const Int3D& pos, std::uint32_t n) {
+  return low + static_cast<int>(random(pos, n) % static_cast<std::uint32_t>(high - low + 1));
+}
+
 std::vector<std::pair<Int3D, Voxel>> WorldGenerator::build_tree(int x, int y, int z) const {
   std::vector<std::pair<Int3D, Voxel>> parts;
   int i, j, k;
 
-  // the randomness needs to be seeded by x,y,z, so the results don't depend on when this is called
-  int tree_height = common::random_int(5, 8);
+  Int3D root{x, y, z};
+  int tree_height = random_int(5, 8, root, 0);
   int height_without_leaves;
   if (tree_height >= 7) {
-    height_without_leaves = common::random_int(3, 4);
+    height_without_leaves = random_int(3, 4, root, 1);
   } else {
-    height_without_leaves = common::random_int(2, 3);
+    height_without_leaves = random_int(2, 3, root, 1);
   }
 
   i = x, j = y, k = z;
@@ -110,7 +137,16 @@ std::vector<std::pair<Int3D, Voxel>> WorldGenerator::build_tree(int x, int y, in
   return parts;
 }
 
-void WorldGenerator::load_features(Section& section) {
+// Smooths the section's elevations and places its features, the neighbours
+// only need their elevations
+void WorldGenerator::prepare_section(Section& section, const SectionMap& sections) const {
+  section.prepare_once([&] {
+    section.compute_subsection_elevations(sections);
+    load_features(section);
+  });
+}
+
+void WorldGenerator::load_features(Section& section) const {
   auto& loc = section.get_location();
 
   int sec_x_offset = cs_math::mod(loc[0], (tree_root_grid_sz_x / Section::sz_x)) * Section::sz_x;
@@ -127,45 +163,61 @@ void WorldGenerator::load_features(Section& section) {
           for (auto& [coord, voxel] : tree)
             section.insert_into_features(coord[0], coord[1], coord[2], voxel);
         } else {
-          auto [n1, n2, n3] = grass_gen_.noises<3>(x, z);
-          if (n1 > 0.6)
+          int i = x + Section::sz_x * z;
+          if (feature_noise_[0][i] > 0.6)
             section.insert_into_features(x_global, subsection_elevation + 1, z_global, Voxel::grass);
-          else if (n2 > 0.7)
+          else if (feature_noise_[1][i] > 0.7)
             section.insert_into_features(x_global, subsection_elevation + 1, z_global, Voxel::sunflower);
-          else if (n3 > 0.7)
+          else if (feature_noise_[2][i] > 0.7)
             section.insert_into_features(x_global, subsection_elevation + 1, z_global, Voxel::roses);
         }
       } else if (
         landcover == common::LandCover::grass ||
         landcover == common::LandCover::shrubs) {
-        auto n = grass_gen_.noise(x, z);
-        if (n > 0.65)
+        if (feature_noise_[0][x + Section::sz_x * z] > 0.65)
           section.insert_into_features(x_global, subsection_elevation + 1, z_global, Voxel::grass);
       }
     }
   }
+  section.finish_features();
 }
 
-void WorldGenerator::fill_chunk(Chunk& chunk, std::unordered_map<Location2D, Section, Location2DHash>& sections) {
+void WorldGenerator::fill_chunk(Chunk& chunk, const SectionMap& sections) const {
   auto& location = chunk.get_location();
 
   for (auto x : {-1, 0, 1}) {
-    for (auto z : {-1, 0, 1}) {
-      auto section_loc = Location2D{location[0] + x, location[2] + z};
-      auto& section = sections.at(section_loc);
-      if (!section.has_subsection_elevations())
-        section.compute_subsection_elevations(sections);
-      if (!section.is_features_loaded()) {
-        load_features(section);
-        section.set_features_loaded(true);
-      }
+    for (auto z : {-1, 0, 1})
+      prepare_section(*sections.at(Location2D{location[0] + x, location[2] + z}), sections);
+  }
+  auto& section = *sections.at(Location2D{location[0], location[2]});
+
+  auto landcover_voxel = [&section](int x, int z) {
+    auto landcover = section.get_landcover(x, z);
+    if (landcover == common::LandCover::bare) {
+      return Voxel::stone;
+    } else if (landcover == common::LandCover::water) {
+      return Voxel::water_full;
+    } else {
+      return Voxel::dirt;
+    }
+  };
+
+  int y_global = location[1] * Chunk::sz_y;
+
+  // chunks entirely below the surface of a single landcover stay uniform
+  bool solid = true;
+  auto solid_voxel = landcover_voxel(0, 0);
+  for (int z = 0; z < Chunk::sz_z && solid; ++z) {
+    for (int x = 0; x < Chunk::sz_x && solid; ++x) {
+      solid = section.get_subsection_elevation(x, z) >= y_global + Chunk::sz_y - 1 &&
+              landcover_voxel(x, z) == solid_voxel;
     }
   }
-  auto& section = sections.at(Location2D{location[0], location[2]});
+  if (solid)
+    chunk.fill(solid_voxel);
 
   int empty_subsections = 0;
-  int y_global = location[1] * Chunk::sz_y;
-  for (int z = 0; z < Chunk::sz_z; ++z) {
+  for (int z = 0; z < Chunk::sz_z && !solid; ++z) {
     for (int x = 0; x < Chunk::sz_x; ++x) {
       int height = section.get_subsection_elevation(x, z);
       if (height < y_global) {
@@ -173,15 +225,7 @@ void WorldGenerator::fill_chunk(Chunk& chunk, std::unordered_map<Location2D, Sec
         continue;
       }
 
-      auto landcover = section.get_landcover(x, z);
-      Voxel voxel;
-      if (landcover == common::LandCover::bare) {
-        voxel = Voxel::stone;
-      } else if (landcover == common::LandCover::water) {
-        voxel = Voxel::water_full;
-      } else {
-        voxel = Voxel::dirt;
-      }
+      auto voxel = landcover_voxel(x, z);
 
       int y = y_global;
       for (; y < (y_global + Chunk::sz_y) && y <= height; ++y) {
@@ -194,10 +238,10 @@ void WorldGenerator::fill_chunk(Chunk& chunk, std::unordered_map<Location2D, Sec
 
   int num_features = 0;
   for (auto [x, z] : section_order) {
-    auto& section = sections.at(Location2D{location[0] + x, location[2] + z});
-    auto& features = section.get_features(location);
-    for (auto [idx, voxel] : features)
-      chunk.set_voxel(idx, voxel);
+    auto& section = *sections.at(Location2D{location[0] + x, location[2] + z});
+    auto features = section.get_features(location);
+    for (auto& feature : features)
+      chunk.set_voxel(feature.idx, feature.voxel);
     num_features += features.size();
   }
   if (num_features > 0)
@@ -1,6 +1,7 @@
 #ifndef WORLD_GENERATOR_H
 #define WORLD_GENERATOR_H
 
+#include <cstdint>
 #include <memory>
 #include <unordered_set>
 #include <vector>
@@ -13,14 +14,16 @@
 class WorldGenerator {
 public:
   WorldGenerator();
-  void fill_chunk(Chunk& chunk, std::unordered_map<Location2D, Section, Location2DHash>& sections);
-  bool ready_to_fill(Location& location, const std::unordered_map<Location2D, Section, Location2DHash>& sections) const;
+  // Safe to call from several threads at once, each section is prepared by whichever gets to it first
+  void fill_chunk(Chunk& chunk, const SectionMap& sections) const;
+  bool ready_to_fill(const Location& location, const SectionMap& sections) const;
+  // the sections fill_chunk reads for location, to fill it from while sections changes
+  SectionMap get_sections_to_fill(const Location& location, const SectionMap& sections) const;
 
   std::vector<std::pair<Int3D, Voxel>> build_tree(int x, int y, int z) const;
 
-private:
   struct NoiseGenerator {
-    double noise(double x, double y, double shift = 0) {
+    double noise(double x, double y, double shift = 0) const {
       x += shift;
       y += shift;
       double maxAmp = 0;
@@ -41,13 +44,31 @@ private:
       return value;
     }
 
-    template <int N>
-    std::array<double, N> noises(double x, double y, double shift = 4096) {
-      std::array<double, N> arr;
-      for (int i = 0; i < N; ++i) {
-        arr[i] = noise(x, y, shift * i);
+    using Grid = std::array<double, Section::sz>;
+
+    // The same values as noise() at every column of a section sized grid
+    // from (x, y), worked out an octave at a time across the grid
+    Grid noise_grid(double x, double y, double shift = 0) const {
+      Grid values{};
+      double maxAmp = 0;
+      double amp = 1;
+      double freq = scale;
+
+      for (int i = 0; i < octaves; ++i) {
+        for (int dy = 0; dy < Section::sz_z; ++dy) {
+          for (int dx = 0; dx < Section::sz_x; ++dx)
+            values[dx + Section::sz_x * dy] += open_simplex_noise2(ctx, (x + dx + shift) * freq, (y + dy + shift) * freq) * amp;
+        }
+        maxAmp += amp;
+        amp *= persistence;
+        freq *= 2;
       }
-      return arr;
+
+      for (auto& value : values) {
+        value /= maxAmp;
+        value = value * (high - low) / 2 + (high + low) / 2;
+      }
+      return values;
     }
 
     osn_context* ctx;
@@ -58,9 +79,15 @@ private:
     double high = 1;
   };
 
-  void load_features(Section& section);
+private:
+  static std::uint32_t random(const Int3D& pos, std::uint32_t n);
+  static int random_int(int low, int high, const Int3D& pos, std::uint32_t n);
+  void prepare_section(Section& section, const SectionMap& sections) const;
+  void load_features(Section& section) const;
 
   NoiseGenerator grass_gen_;
+  // load_features samples at section local columns, so every section shares these
+  std::array<NoiseGenerator::Grid, 3> feature_noise_;
 
   std::vector<bool> tree_roots_;
   static constexpr int tree_root_grid_sz_x = 128;
@@ -1,19 +1,173 @@
 #include "chunk.h"
+#include <algorithm>
+#include <bitset>
+#include <cstring>
 #include <iostream>
 #include <queue>
+#include "varint.h"
+
+bool Chunk::palette_compression = true;
 
 Chunk::Chunk(int x, int y, int z)
-    : location_{x, y, z}, voxels_(sz, Voxel::empty) {
+    : location_{x, y, z} {
+}
+
+/*
+  Chunk blobs, version 1:
+  - a 4 byte header: 'c', 'k', the version and 0xff. In the old format of 32
+    bit runs the fourth byte is the top of the first voxel, so never 0xff.
+  - the palette size, then one byte per palette voxel
+  - runs in storage order, x fastest then y then z, each a palette index
+    byte and a LEB128 varint length
+  Decoding is a memset per run into dense storage, or the same a word at a
+  time into packed storage.
+*/
+namespace {
+  constexpr std::array<unsigned char, 3> codec_magic = {'c', 'k', Chunk::codec_version};
+  constexpr unsigned char codec_marker = 0xff;
+  constexpr int codec_header_sz = 4;
+}
+
+Chunk::Chunk(const Location& loc, const unsigned char* data, int data_size) : location_{loc} {
+  bool versioned = data_size >= codec_header_sz && data[3] == codec_marker &&
+                   data[0] == codec_magic[0] && data[1] == codec_magic[1];
+  if (versioned)
+    decode(data, data_size);
+  else
+    decode_legacy(data, data_size);
 }
 
-Chunk::Chunk(const Location& loc, const unsigned char* data, int data_size) : location_{loc}, voxels_(sz, Voxel::empty) {
+std::vector<unsigned char> Chunk::encode() const {
+  std::vector<unsigned char> data(codec_magic.begin(), codec_magic.end());
+  data.push_back(codec_marker);
+  if (storage_ == Storage::uniform) {
+    data.insert(data.end(), {1, static_cast<unsigned char>(uniform_voxel_), 0});
+    Varint::write(data, sz);
+    return data;
+  }
+
+  std::vector<Voxel> unpacked;
+  const Voxel* voxels = voxels_.data();
+  if (storage_ == Storage::packed) {
+    unpacked = get_voxels();
+    voxels = unpacked.data();
+  }
+
+  constexpr auto num_voxels = static_cast<std::size_t>(Voxel::voxel_enum_size);
+  std::array<unsigned char, num_voxels> lookup;
+  lookup.fill(0xff);
+  std::vector<Voxel> palette;
+  for (int i = 0; i < sz; ++i) {
+    auto v = static_cast<std::size_t>(voxels[i]);
+    if (lookup[v] == 0xff) {
+      lookup[v] = palette.size();
+      palette.push_back(voxels[i]);
+    }
+  }
+  data.push_back(palette.size());
+  for (auto voxel : palette)
+    data.push_back(static_cast<unsigned char>(voxel));
+
+  int start = 0;
+  for (int i = 1; i <= sz; ++i) {
+    if (i == sz || voxels[i] != voxels[start]) {
+      data.push_back(lookup[static_cast<std::size_t>(voxels[start])]);
+      Varint::write(data, i - start);
+      start = i;
+    }
+  }
+  return data;
+}
+
+// A corrupt or truncated blob leaves the chunk empty rather than half written
+void Chunk::decode(const unsigned char* data, int data_size) {
+  auto reset = [this] {
+    fill(Voxel::empty);
+    set_flag(ChunkFlags::Empty);
+  };
+  auto corrupt = [&reset] {
+    std::cerr << "Corrupt chunk data" << std::endl;
+    reset();
+  };
+  int pos = codec_header_sz;
+  if (data[2] != codec_version || pos >= data_size) {
+    std::cerr << "Unknown chunk data version " << static_cast<int>(data[2]) << std::endl;
+    reset();
+    return;
+  }
+  int palette_sz = data[pos++];
+  if (palette_sz == 0 || pos + palette_sz > data_size)
+    return corrupt();
+  std::vector<Voxel> palette(palette_sz);
+  for (auto& voxel : palette) {
+    if (data[pos] >= static_cast<int>(Voxel::voxel_enum_size))
+      return corrupt();
+    voxel = static_cast<Voxel>(data[pos++]);
+  }
+  if (palette_sz == 1) {
+    fill(palette[0]);
+    return;
+  }
+
+  // the palette is already known, so runs go straight into packed storage
+  // when it is small enough, with no scan in compact()
+  bool packed = palette_compression && palette_sz <= max_palette_sz;
+  if (packed) {
+    bits_per_voxel_ = palette_sz <= 2 ? 1 : palette_sz <= 4 ? 2 : 4;
+    packed_.assign(sz * bits_per_voxel_ / 64, 0);
+    palette_ = std::move(palette);
+    storage_ = Storage::packed;
+  } else {
+    voxels_.acquire();
+    std::fill_n(voxels_.data(), sz, Voxel::empty);
+    storage_ = Storage::dense;
+  }
+  int i = 0;
+  while (pos < data_size && i < sz) {
+    int palette_idx = data[pos++];
+    int length = Varint::read(data, data_size, pos);
+    if (palette_idx >= palette_sz || length == 0 || i + length > sz)
+      return corrupt();
+    if (packed)
+      fill_packed(i, length, palette_idx);
+    else
+      std::memset(voxels_.data() + i, static_cast<int>(palette[palette_idx]), length);
+    i += length;
+  }
+  if (i < sz)
+    return corrupt();
+}
+
+// Sets count voxels from i to one palette index, a word at a time
+void Chunk::fill_packed(int i, int count, std::uint64_t palette_idx) {
+  // the index repeated across the whole word
+  std::uint64_t pattern = ~std::uint64_t{0} / ((std::uint64_t{1} << bits_per_voxel_) - 1) * palette_idx;
+  int bit = i * bits_per_voxel_;
+  int end = (i + count) * bits_per_voxel_;
+  while (bit < end) {
+    int offset = bit & 63;
+    int n = std::min(64 - offset, end - bit);
+    std::uint64_t mask = (n == 64 ? ~std::uint64_t{0} : (std::uint64_t{1} << n) - 1) << offset;
+    auto& word = packed_[bit >> 6];
+    word = (word & ~mask) | (pattern & mask);
+    bit += n;
+  }
+}
+
+// Blobs saved before codec_version, 32 bit runs of a voxel and a length with
+// z fastest, then x, then y
+void Chunk::decode_legacy(const unsigned char* data, int data_size) {
   int vidx = 0;
-  for (int i = 0; i < data_size; i += 4) {
-    // memory alignment...
-    std::uint32_t run = *(int*)(&data[i]);
+  for (int i = 0; i + 4 <= data_size; i += 4) {
+    std::uint32_t run;
+    std::memcpy(&run, data + i, sizeof(run));
     auto voxel = static_cast<Voxel>((common::chunk_data_voxel_mask & run) >> 16);
     std::uint32_t run_length = common::chunk_data_run_length_mask & run;
-    for (int n = 0; n < run_length; ++n) {
+    if (vidx == 0 && run_length >= sz) {
+      fill(voxel);
+      return;
+    }
+    for (int n = 0; n < run_length && vidx < sz; ++n) {
       auto [x, y, z] = flat_index_to_3d_zxy(vidx++);
       set_voxel(x, y, z, voxel);
     }
@@ -25,13 +179,24 @@ const Location& Chunk::get_location() const {
 }
 
 Voxel Chunk::get_voxel(int x, int y, int z) const {
-  return voxels_[x + sz_x * (y + sz_y * z)];
+  return get_voxel(x + sz_x * (y + sz_y * z));
 }
 
 int Chunk::get_index(int x, int y, int z) {
   return x + sz_x * (y + sz_y * z);
 }
 
+// Slabs holding the voxels from y - 1 to y + 1, the ones whose mesh a change
+// at local height y can affect
+std::uint32_t Chunk::get_slabs_around(int y) {
+  std::uint32_t slabs = 1u << (y / slab_sz_y);
+  if (y > 0)
+    slabs |= 1u << ((y - 1) / slab_sz_y);
+  if (y < sz_y - 1)
+    slabs |= 1u << ((y + 1) / slab_sz_y);
+  return slabs;
+}
+
 int Chunk::get_index(const Int3D& coord) {
   return coord[0] + sz_x * (coord[1] + sz_y * coord[2]);
 }
@@ -55,8 +220,18 @@ std::array<int, 3> Chunk::flat_index_to_3d(int i) {
 }
 
 void Chunk::set_voxel(int i, Voxel voxel) {
-  Voxel cur = voxels_[i];
-  voxels_[i] = voxel;
+  if (storage_ == Storage::dense) {
+    voxels_[i] = voxel;
+    return;
+  }
+  if (storage_ == Storage::uniform) {
+    if (voxel == uniform_voxel_)
+      return;
+    expand();
+    voxels_[i] = voxel;
+    return;
+  }
+  set_packed_voxel(i, voxel);
 }
 
 void Chunk::set_voxel(int x, int y, int z, Voxel voxel) {
@@ -64,8 +239,164 @@ void Chunk::set_voxel(int x, int y, int z, Voxel voxel) {
   set_voxel(i, voxel);
 }
 
+// Sets count voxels in storage order from i
+void Chunk::set_voxels(int i, int count, Voxel voxel) {
+  if (storage_ == Storage::uniform) {
+    if (voxel == uniform_voxel_)
+      return;
+    expand();
+  } else if (storage_ == Storage::packed) {
+    auto it = std::find(palette_.begin(), palette_.end(), voxel);
+    if (it != palette_.end()) {
+      fill_packed(i, count, it - palette_.begin());
+      return;
+    }
+    // adds the voxel to the palette or unpacks, then the rest is one of the
+    // cases above
+    set_packed_voxel(i, voxel);
+    if (count > 1)
+      set_voxels(i + 1, count - 1, voxel);
+    return;
+  }
+  std::fill_n(voxels_.data() + i, count, voxel);
+}
+
 Voxel Chunk::get_voxel(int i) const {
-  return voxels_[i];
+  if (storage_ == Storage::dense)
+    return voxels_[i];
+  if (storage_ == Storage::uniform)
+    return uniform_voxel_;
+  return get_packed_voxel(i);
+}
+
+Voxel Chunk::get_packed_voxel(int i) const {
+  int bit = i * bits_per_voxel_;
+  std::uint64_t mask = (std::uint64_t{1} << bits_per_voxel_) - 1;
+  auto palette_idx = (packed_[bit >> 6] >> (bit & 63)) & mask;
+  return palette_[palette_idx];
+}
+
+void Chunk::set_packed_voxel(int i, Voxel voxel) {
+  auto it = std::find(palette_.begin(), palette_.end(), voxel);
+  if (it == palette_.end()) {
+    if (palette_.size() == (std::size_t{1} << bits_per_voxel_)) {
+      // out of room in the palette, widen the indices or fall back to dense storage
+      if (bits_per_voxel_ * 2 > 4 || palette_.size() == max_palette_sz) {
+        unpack();
+        voxels_[i] = voxel;
+        return;
+      }
+      auto palette = palette_;
+      unpack();
+      pack(palette, palette.size() < 4 ? 2 : 4);
+    }
+    palette_.push_back(voxel);
+    it = palette_.end() - 1;
+  }
+  std::uint64_t palette_idx = it - palette_.begin();
+  int bit = i * bits_per_voxel_;
+  std::uint64_t mask = (std::uint64_t{1} << bits_per_voxel_) - 1;
+  auto& word = packed_[bit >> 6];
+  word &= ~(mask << (bit & 63));
+  word |= palette_idx << (bit & 63);
+}
+
+// Expects dense storage, palette must contain every voxel in the chunk
+void Chunk::pack(const std::vector<Voxel>& palette, int bits_per_voxel) {
+  std::array<std::uint8_t, static_cast<std::size_t>(Voxel::voxel_enum_size)> lookup{};
+  for (std::size_t idx = 0; idx < palette.size(); ++idx)
+    lookup[static_cast<std::size_t>(palette[idx])] = idx;
+
+  int voxels_per_word = 64 / bits_per_voxel;
+  std::vector<std::uint64_t> packed(sz / voxels_per_word, 0);
+  for (int i = 0; i < sz; ++i) {
+    std::uint64_t palette_idx = lookup[static_cast<std::size_t>(voxels_[i])];
+    int bit = i * bits_per_voxel;
+    packed[bit >> 6] |= palette_idx << (bit & 63);
+  }
+
+  palette_ = palette;
+  packed_ = std::move(packed);
+  bits_per_voxel_ = bits_per_voxel;
+  storage_ = Storage::packed;
+  voxels_.release();
+}
+
+void Chunk::unpack() {
+  voxels_.acquire();
+  for (int i = 0; i < sz; ++i) voxels_[i] = get_packed_voxel(i);
+  palette_.clear();
+  palette_.shrink_to_fit();
+  packed_.clear();
+  packed_.shrink_to_fit();
+  bits_per_voxel_ = 0;
+  storage_ = Storage::dense;
+}
+
+void Chunk::expand() {
+  voxels_.acquire();
+  std::fill_n(voxels_.data(), sz, uniform_voxel_);
+  storage_ = Storage::dense;
+}
+
+void Chunk::fill(Voxel voxel) {
+  voxels_.release();
+  palette_.clear();
+  palette_.shrink_to_fit();
+  packed_.clear();
+  packed_.shrink_to_fit();
+  bits_per_voxel_ = 0;
+  uniform_voxel_ = voxel;
+  storage_ = Storage::uniform;
+}
+
+// Collapses the chunk to a single value if it is uniform, otherwise
+// switches to palette mode if it holds few enough distinct voxels
+void Chunk::compact() {
+  if (storage_ != Storage::dense)
+    return;
+
+  std::vector<Voxel> palette;
+  std::bitset<static_cast<std::size_t>(Voxel::voxel_enum_size)> seen;
+  for (int i = 0; i < sz; ++i) {
+    auto voxel = voxels_[i];
+    auto v = static_cast<std::size_t>(voxel);
+    if (seen.test(v))
+      continue;
+    seen.set(v);
+    palette.push_back(voxel);
+    if (palette.size() > max_palette_sz)
+      return;
+  }
+
+  if (palette.size() == 1) {
+    fill(palette[0]);
+    return;
+  }
+  if (!palette_compression)
+    return;
+
+  int bits_per_voxel = palette.size() <= 2 ? 1 : palette.size() <= 4 ? 2 : 4;
+  pack(palette, bits_per_voxel);
+}
+
+bool Chunk::is_uniform() const {
+  return storage_ == Storage::uniform;
+}
+
+Voxel Chunk::get_uniform_voxel() const {
+  return uniform_voxel_;
+}
+
+bool Chunk::is_packed() const {
+  return storage_ == Storage::packed;
+}
+
+std::size_t Chunk::get_memory_usage() const {
+  return sizeof(Chunk) +
+         (voxels_.empty() ? 0 : sz * sizeof(Voxel)) +
+         palette_.capacity() * sizeof(Voxel) +
+         packed_.capacity() * sizeof(std::uint64_t);
 }
 
 Location Chunk::pos_to_loc(const glm::dvec3& position) {
@@ -83,6 +414,24 @@ Int3D Chunk::to_local(Int3D coord) {
   return Int3D{x, y, z};
 }
 
+// Copies count voxels starting at index i, whatever the storage
+void Chunk::copy_voxels(int i, int count, Voxel* out) const {
+  if (storage_ == Storage::dense)
+    std::copy_n(voxels_.data() + i, count, out);
+  else if (storage_ == Storage::uniform)
+    std::fill_n(out, count, uniform_voxel_);
+  else {
+    for (int j = 0; j < count; ++j)
+      out[j] = get_packed_voxel(i + j);
+  }
+}
+
 const std::vector<Voxel> Chunk::get_voxels() const {
-  return voxels_;
+  if (storage_ == Storage::dense)
+    return std::vector<Voxel>(voxels_.data(), voxels_.data() + sz);
+  if (storage_ == Storage::uniform)
+    return std::vector<Voxel>(sz, uniform_voxel_);
+  std::vector<Voxel> voxels(sz);
+  for (int i = 0; i < sz; ++i) voxels[i] = get_packed_voxel(i);
+  return voxels;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include <array>
 #include <unordered_set>
 #include <vector>
+#include "chunk_buffer_pool.h"
 #include "common.h"
 #include "flag_manager.h"
 #include "section.h"
@@ -15,9 +16,18 @@ enum class ChunkFlags : uint32_t {
   Empty = 1 << 1,
 };
 
+/*
+  Voxels are stored in one of three ways:
+  - uniform: a single voxel value for the whole chunk, nothing is allocated
+  - packed: indices into a small palette packed into 64 bit words
+  - dense: one byte per voxel, in a buffer drawn from ChunkBufferPool
+  Chunks start out uniform and expand to dense storage on the first write that
+  breaks uniformity. compact() shrinks them back down.
+*/
 class Chunk : public FlagManager<ChunkFlags> {
 public:
   Chunk(int x, int y, int z);
+  // from a blob made by encode(), or one of the 32 bit runs saved before it
   Chunk(const Location& loc, const unsigned char* data, int data_size);
 
   const Location& get_location() const;
@@ -26,9 +36,18 @@ public:
   static int get_index(int x, int y, int z);
   static int get_index(const Int3D& coord);
   const std::vector<Voxel> get_voxels() const;
+  void copy_voxels(int i, int count, Voxel* out) const;
 
   void set_voxel(int i, Voxel voxel);
   void set_voxel(int x, int y, int z, Voxel voxel);
+  void set_voxels(int i, int count, Voxel voxel);
+
+  void fill(Voxel voxel);
+  void compact();
+  bool is_uniform() const;
+  Voxel get_uniform_voxel() const;
+  bool is_packed() const;
+  std::size_t get_memory_usage() const;
 
   static Location pos_to_loc(const glm::dvec3& position);
   static std::array<int, 3> flat_index_to_3d(int i);
@@ -39,13 +58,46 @@ public:
   static constexpr int sz_y = common::chunk_sz_y;
   static constexpr int sz_z = common::chunk_sz_z;
   static constexpr int sz = common::chunk_sz;
+  static constexpr int max_palette_sz = 16;
+  // chunks are meshed in horizontal slabs so an edit only remeshes the slabs
+  // it touches
+  static constexpr int slab_sz_y = 8;
+  static constexpr int num_slabs = sz_y / slab_sz_y;
+  static constexpr std::uint32_t all_slabs = (1u << num_slabs) - 1;
+  static std::uint32_t get_slabs_around(int y);
+  static constexpr bool in_slabs(std::uint32_t slabs, int y) {
+    return y >= 0 && y < sz_y && ((slabs >> (y / slab_sz_y)) & 1);
+  }
+  static bool palette_compression;
+
+  std::vector<unsigned char> encode() const;
+  static constexpr std::uint8_t codec_version = 1;
 
 private:
+  enum class Storage : std::uint8_t {
+    uniform,
+    packed,
+    dense,
+  };
+
   static std::array<int, 3> flat_index_to_3d_zxy(int i);
 
-  std::vector<Voxel> voxels_;
+  Voxel get_packed_voxel(int i) const;
+  void set_packed_voxel(int i, Voxel voxel);
+  void fill_packed(int i, int count, std::uint64_t palette_idx);
+  void pack(const std::vector<Voxel>& palette, int bits_per_voxel);
+  void unpack();
+  void expand();
+  void decode(const unsigned char* data, int data_size);
+  void decode_legacy(const unsigned char* data, int data_size);
+
+  Storage storage_ = Storage::uniform;
+  Voxel uniform_voxel_ = Voxel::empty;
+  VoxelBuffer voxels_;
+  std::vector<Voxel> palette_;
+  std::vector<std::uint64_t> packed_;
+  int bits_per_voxel_ = 0;
   Location location_;
-  std::uint32_t flags_ = 0;
 };
 
-#endif
\ No newline at end of file
+#endif
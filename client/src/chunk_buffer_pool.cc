@@ -0,0 +1,87 @@
+#include "chunk_buffer_pool.h"
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+void ChunkBufferPool::allocate_slab() {
+  auto& slab = slabs_.emplace_back(std::make_unique_for_overwrite<Voxel[]>(buffer_sz * buffers_per_slab));
+  for (std::size_t i = 0; i < buffers_per_slab; ++i)
+    free_.push_back(slab.get() + i * buffer_sz);
+}
+
+Voxel* ChunkBufferPool::acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (free_.empty())
+    allocate_slab();
+  auto* buffer = free_.back();
+  free_.pop_back();
+  ++acquires_;
+  peak_in_use_ = std::max(peak_in_use_, ++in_use_);
+  return buffer;
+}
+
+void ChunkBufferPool::release(Voxel* buffer) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  free_.push_back(buffer);
+  ++releases_;
+  --in_use_;
+}
+
+ChunkBufferPool::Stats ChunkBufferPool::get_stats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return Stats{
+    slabs_.size(),
+    in_use_,
+    free_.size(),
+    peak_in_use_,
+    acquires_,
+    releases_,
+    slabs_.size() * buffers_per_slab * buffer_sz * sizeof(Voxel)};
+}
+
+VoxelBuffer::VoxelBuffer(const VoxelBuffer& other) {
+  if (other.data_ != nullptr) {
+    acquire();
+    std::memcpy(data_, other.data_, ChunkBufferPool::buffer_sz * sizeof(Voxel));
+  }
+}
+
+VoxelBuffer::VoxelBuffer(VoxelBuffer&& other) noexcept : data_(std::exchange(other.data_, nullptr)) {
+}
+
+VoxelBuffer& VoxelBuffer::operator=(const VoxelBuffer& other) {
+  if (this == &other)
+    return *this;
+  if (other.data_ == nullptr) {
+    release();
+    return *this;
+  }
+  if (data_ == nullptr)
+    acquire();
+  std::memcpy(data_, other.data_, ChunkBufferPool::buffer_sz * sizeof(Voxel));
+  return *this;
+}
+
+VoxelBuffer& VoxelBuffer::operator=(VoxelBuffer&& other) noexcept {
+  if (this != &other) {
+    release();
+    data_ = std::exchange(other.data_, nullptr);
+  }
+  return *this;
+}
+
+VoxelBuffer::~VoxelBuffer() {
+  release();
+}
+
+void VoxelBuffer::acquire() {
+  if (data_ == nullptr)
+    data_ = ChunkBufferPool::instance()->acquire();
+}
+
+void VoxelBuffer::release() {
+  if (data_ != nullptr) {
+    ChunkBufferPool::instance()->release(data_);
+    data_ = nullptr;
+  }
+}
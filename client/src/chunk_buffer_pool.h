@@ -0,0 +1,78 @@
+#ifndef CHUNK_BUFFER_POOL_H
+#define CHUNK_BUFFER_POOL_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "common.h"
+#include "voxel.h"
+
+/*
+  Hands out fixed-size dense voxel buffers carved from larger slabs.
+  Buffers released by evicted chunks go back on a free list and are handed to
+  the next chunk that needs one, so streaming doesn't churn the heap.
+*/
+class ChunkBufferPool final {
+public:
+  struct Stats {
+    std::size_t slabs;
+    std::size_t buffers_in_use;
+    std::size_t buffers_free;
+    std::size_t peak_buffers_in_use;
+    std::uint64_t acquires;
+    std::uint64_t releases;
+    std::size_t bytes_reserved;
+  };
+
+  static ChunkBufferPool* instance() {
+    static ChunkBufferPool* instance = new ChunkBufferPool();
+    return instance;
+  }
+
+  ChunkBufferPool(const ChunkBufferPool& other) = delete;
+  ChunkBufferPool* operator=(const ChunkBufferPool* other) = delete;
+
+  Voxel* acquire();
+  void release(Voxel* buffer);
+  Stats get_stats() const;
+
+  static constexpr std::size_t buffer_sz = common::chunk_sz;
+  static constexpr std::size_t buffers_per_slab = 32;
+
+private:
+  ChunkBufferPool() = default;
+  void allocate_slab();
+
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Voxel[]>> slabs_;
+  std::vector<Voxel*> free_;
+  std::size_t in_use_ = 0;
+  std::size_t peak_in_use_ = 0;
+  std::uint64_t acquires_ = 0;
+  std::uint64_t releases_ = 0;
+};
+
+// Owning handle to a pooled buffer of ChunkBufferPool::buffer_sz voxels
+class VoxelBuffer {
+public:
+  VoxelBuffer() = default;
+  VoxelBuffer(const VoxelBuffer& other);
+  VoxelBuffer(VoxelBuffer&& other) noexcept;
+  VoxelBuffer& operator=(const VoxelBuffer& other);
+  VoxelBuffer& operator=(VoxelBuffer&& other) noexcept;
+  ~VoxelBuffer();
+
+  void acquire();
+  void release();
+  bool empty() const { return data_ == nullptr; }
+  Voxel* data() { return data_; }
+  const Voxel* data() const { return data_; }
+  Voxel& operator[](std::size_t i) { return data_[i]; }
+  const Voxel& operator[](std::size_t i) const { return data_[i]; }
+
+private:
+  Voxel* data_ = nullptr;
+};
+
+#endif
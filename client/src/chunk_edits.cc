@@ -0,0 +1,98 @@
+#include "chunk_edits.h"
+
+#include <array>
+#include <iostream>
+#include "varint.h"
+
+/*
+  Edit log blobs, version 1:
+  - a 4 byte header: 'c', 'e', the version and 0xff, which no chunk blob
+    starts with
+  - the number of edits, then each edit as a LEB128 varint of its index less
+    the previous one's, and the voxel byte
+*/
+namespace {
+  constexpr std::array<unsigned char, 3> codec_magic = {'c', 'e', ChunkEdits::codec_version};
+  constexpr unsigned char codec_marker = 0xff;
+  constexpr int codec_header_sz = 4;
+}
+
+ChunkEdits::ChunkEdits(const Location& loc) : location_{loc} {}
+
+ChunkEdits::ChunkEdits(const Location& loc, const unsigned char* data, int data_size) : location_{loc} {
+  int pos = codec_header_sz;
+  auto count = Varint::read(data, data_size, pos);
+  if (count > max_edits) {
+    std::cerr << "Corrupt chunk edits" << std::endl;
+    return;
+  }
+  edits_.reserve(count);
+  std::uint32_t i = 0;
+  for (std::uint32_t j = 0; j < count; ++j) {
+    auto delta = Varint::read(data, data_size, pos);
+    i += delta;
+    if (pos >= data_size || delta >= Chunk::sz || i >= Chunk::sz || (j > 0 && delta == 0)) {
+      std::cerr << "Corrupt chunk edits" << std::endl;
+      edits_.clear();
+      return;
+    }
+    auto voxel = data[pos++];
+    edits_.push_back({static_cast<std::uint16_t>(i), static_cast<Voxel>(voxel)});
+  }
+}
+
+std::optional<ChunkEdits> ChunkEdits::diff(const Chunk& chunk, const Chunk& generated) {
+  ChunkEdits edits(chunk.get_location());
+  if (chunk.is_uniform() && generated.is_uniform() && chunk.get_uniform_voxel() == generated.get_uniform_voxel())
+    return edits;
+  // a slab at a time keeps both copies small
+  constexpr int slab_sz = Chunk::sz_x * Chunk::sz_y;
+  std::array<Voxel, slab_sz> voxels, generated_voxels;
+  for (int start = 0; start < Chunk::sz; start += slab_sz) {
+    chunk.copy_voxels(start, slab_sz, voxels.data());
+    generated.copy_voxels(start, slab_sz, generated_voxels.data());
+    for (int i = 0; i < slab_sz; ++i) {
+      if (voxels[i] == generated_voxels[i])
+        continue;
+      if (edits.edits_.size() == max_edits)
+        return std::nullopt;
+      edits.edits_.push_back({static_cast<std::uint16_t>(start + i), voxels[i]});
+    }
+  }
+  return edits;
+}
+
+bool ChunkEdits::is_edit_log(const unsigned char* data, int data_size) {
+  return data_size >= codec_header_sz && data[0] == codec_magic[0] && data[1] == codec_magic[1] &&
+         data[3] == codec_marker;
+}
+
+const Location& ChunkEdits::get_location() const {
+  return location_;
+}
+
+std::size_t ChunkEdits::size() const {
+  return edits_.size();
+}
+
+// A generated chunk of air is flagged Empty, which edits can undo
+void ChunkEdits::apply(Chunk& chunk) const {
+  for (auto& [i, voxel] : edits_) {
+    chunk.set_voxel(i, voxel);
+    if (voxel != Voxel::empty)
+      chunk.unset_flag(ChunkFlags::Empty);
+  }
+}
+
+std::vector<unsigned char> ChunkEdits::encode() const {
+  std::vector<unsigned char> data(codec_magic.begin(), codec_magic.end());
+  data.push_back(codec_marker);
+  Varint::write(data, edits_.size());
+  int prev = 0;
+  for (auto& [i, voxel] : edits_) {
+    Varint::write(data, i - prev);
+    data.push_back(static_cast<unsigned char>(voxel));
+    prev = i;
+  }
+  return data;
+}
@@ -0,0 +1,43 @@
+#ifndef CHUNK_EDITS_H
+#define CHUNK_EDITS_H
+
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "chunk.h"
+#include "types.h"
+#include "voxel.h"
+
+/*
+  The voxels of a chunk that differ from what the world generator makes
+  there, so an edited chunk can be saved as a short list and rebuilt by
+  generating it again and applying the list. Only chunks with at most
+  max_edits changed voxels are saved this way.
+*/
+class ChunkEdits {
+public:
+  static constexpr int max_edits = Chunk::sz / 16;
+  static constexpr std::uint8_t codec_version = 1;
+
+  // from a blob made by encode(), which is_edit_log() must accept
+  ChunkEdits(const Location& loc, const unsigned char* data, int data_size);
+
+  // Nothing if chunk differs from generated in more than max_edits voxels
+  static std::optional<ChunkEdits> diff(const Chunk& chunk, const Chunk& generated);
+  static bool is_edit_log(const unsigned char* data, int data_size);
+
+  const Location& get_location() const;
+  std::size_t size() const;
+  void apply(Chunk& chunk) const;
+  std::vector<unsigned char> encode() const;
+
+private:
+  explicit ChunkEdits(const Location& loc);
+
+  Location location_;
+  // by increasing index
+  std::vector<std::pair<std::uint16_t, Voxel>> edits_;
+};
+
+#endif
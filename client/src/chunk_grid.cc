@@ -0,0 +1,69 @@
+#include "chunk_grid.h"
+#include <stdexcept>
+
+ChunkGrid::ChunkGrid() : slots_(capacity) {
+}
+
+int ChunkGrid::get_slot(const Location& loc) {
+  int x = loc[0] & (size_x - 1);
+  int y = loc[1] & (size_y - 1);
+  int z = loc[2] & (size_z - 1);
+  return x + size_x * (y + size_y * z);
+}
+
+bool ChunkGrid::contains(const Location& loc) const {
+  return find(loc) != nullptr;
+}
+
+Chunk& ChunkGrid::at(const Location& loc) {
+  auto* chunk = find(loc);
+  if (chunk == nullptr)
+    throw std::out_of_range("ChunkGrid::at");
+  return *chunk;
+}
+
+const Chunk& ChunkGrid::at(const Location& loc) const {
+  auto* chunk = find(loc);
+  if (chunk == nullptr)
+    throw std::out_of_range("ChunkGrid::at");
+  return *chunk;
+}
+
+Chunk* ChunkGrid::find(const Location& loc) {
+  auto& slot = slots_[get_slot(loc)];
+  if (!slot.has_value() || slot->get_location() != loc)
+    return nullptr;
+  return &*slot;
+}
+
+const Chunk* ChunkGrid::find(const Location& loc) const {
+  auto& slot = slots_[get_slot(loc)];
+  if (!slot.has_value() || slot->get_location() != loc)
+    return nullptr;
+  return &*slot;
+}
+
+Chunk* ChunkGrid::get_occupant(const Location& loc) {
+  auto& slot = slots_[get_slot(loc)];
+  return slot.has_value() ? &*slot : nullptr;
+}
+
+Chunk& ChunkGrid::insert(Chunk&& chunk) {
+  auto& slot = slots_[get_slot(chunk.get_location())];
+  if (!slot.has_value())
+    ++size_;
+  slot.emplace(std::move(chunk));
+  return *slot;
+}
+
+void ChunkGrid::erase(const Location& loc) {
+  auto& slot = slots_[get_slot(loc)];
+  if (!slot.has_value() || slot->get_location() != loc)
+    return;
+  slot.reset();
+  --size_;
+}
+
+std::size_t ChunkGrid::size() const {
+  return size_;
+}
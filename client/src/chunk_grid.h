@@ -0,0 +1,60 @@
+#ifndef CHUNK_GRID_H
+#define CHUNK_GRID_H
+
+#include <optional>
+#include <vector>
+#include "chunk.h"
+#include "types.h"
+
+/*
+  Fixed-size 3D ring buffer of chunks. A location maps to its slot by taking
+  its coordinates modulo the grid extents, so lookups are a few bit operations
+  and neighbouring chunks sit next to each other in memory. As the player moves
+  the loaded window scrolls through the grid and a newly inserted chunk takes
+  the place of the chunk size_x (or size_y, size_z) locations behind it.
+*/
+class ChunkGrid {
+public:
+  ChunkGrid();
+
+  bool contains(const Location& loc) const;
+  Chunk& at(const Location& loc);
+  const Chunk& at(const Location& loc) const;
+  Chunk* find(const Location& loc);
+  const Chunk* find(const Location& loc) const;
+  // Chunk currently occupying the slot loc maps to, whatever its location
+  Chunk* get_occupant(const Location& loc);
+  Chunk& insert(Chunk&& chunk);
+  void erase(const Location& loc);
+  std::size_t size() const;
+
+  template <typename F>
+  void for_each(F&& f) {
+    for (auto& slot : slots_) {
+      if (slot.has_value())
+        f(*slot);
+    }
+  }
+
+  template <typename F>
+  void for_each(F&& f) const {
+    for (auto& slot : slots_) {
+      if (slot.has_value())
+        f(*slot);
+    }
+  }
+
+  // Extents have to be powers of two
+  static constexpr int size_x = 16;
+  static constexpr int size_y = 8;
+  static constexpr int size_z = 16;
+  static constexpr int capacity = size_x * size_y * size_z;
+
+private:
+  static int get_slot(const Location& loc);
+
+  std::vector<std::optional<Chunk>> slots_;
+  std::size_t size_ = 0;
+};
+
+#endif
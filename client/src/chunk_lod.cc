@@ -1,48 +1,64 @@
 #include "chunk_lod.h"
-#include <iostream>
-
-template <LodLevel level>
-int ChunkLod<level>::vi(int x, int y, int z) {
-  return x + (2 * sz_x) * (y + sz_y * z);
-};
+#include <array>
 
+// Each voxel comes from a 2x2x2 block of the finer level. Blocks less than
+// half full of cubes are empty, the others take their most common cube,
+// ties going to the upper layer so surfaces keep their top material.
 template <LodLevel level>
 ChunkLod<level>::ChunkLod(const std::vector<Voxel>& voxels) : voxels_(sz, Voxel::empty) {
-
-  for (int y = 0; y < sz_y; ++y) {
-    for (int z = 0; z < sz_z; ++z) {
+  constexpr int fx = 2 * sz_x, fy = 2 * sz_y;
+  std::array<Voxel, 8> block;
+  for (int z = 0; z < sz_z; ++z) {
+    for (int y = 0; y < sz_y; ++y) {
       for (int x = 0; x < sz_x; ++x) {
-        auto v1 = static_cast<std::uint32_t>(voxels[vi(x * 2, y, z * 2)]);
-        auto v2 = static_cast<std::uint32_t>(voxels[vi(x * 2 + 1, y, z * 2)]);
-        auto v3 = static_cast<std::uint32_t>(voxels[vi(x * 2, y, z * 2 + 1)]);
-        auto v4 = static_cast<std::uint32_t>(voxels[vi(x * 2 + 1, y, z * 2 + 1)]);
-        int v;
-        v = v1 * (v1 == v2 || v1 == v3 || v1 == v4);
-        v += (v == 0) * v2 * (v2 == v3 || v2 == v4);
-        v += (v == 0) * v3 * (v3 == v4);
-        v += (v == 0) * v1;
-        v += (v == 0) * v2;
-        v += (v == 0) * v3;
-        v += (v == 0) * v4;
-        voxels_[x + sz_x * (y + sz_y * z)] = static_cast<Voxel>(v);
+        int cubes = 0;
+        for (int i = 0; i < 8; ++i) {
+          int bx = 2 * x + (i & 1), bz = 2 * z + ((i >> 1) & 1), by = 2 * y + (i >> 2);
+          auto voxel = voxels[bx + fx * (by + fy * bz)];
+          if (vops::is_cube(voxel))
+            block[cubes++] = voxel;
+        }
+        if (cubes < 4)
+          continue;
+        Voxel best = Voxel::empty;
+        int best_count = 0;
+        for (int i = cubes - 1; i >= 0; --i) {
+          int count = 0;
+          for (int j = 0; j < cubes; ++j)
+            count += block[j] == block[i];
+          if (count > best_count) {
+            best = block[i];
+            best_count = count;
+          }
+        }
+        voxels_[x + sz_x * (y + sz_y * z)] = best;
       }
     }
   }
+}
 
-  // v merge
+template <LodLevel level>
+ChunkLod<level>::ChunkLod(Voxel voxel) : voxels_(1, voxel) {
 }
 
 template <LodLevel level>
 Voxel ChunkLod<level>::get_voxel(int x, int y, int z) const {
+  if (voxels_.size() == 1)
+    return voxels_[0];
   return voxels_[x + sz_x * (y + sz_y * z)];
 }
 
+template <LodLevel level>
+const std::vector<Voxel>& ChunkLod<level>::get_voxels() const {
+  return voxels_;
+}
+
+template <LodLevel level>
+bool ChunkLod<level>::is_uniform() const {
+  return voxels_.size() == 1;
+}
+
 template class ChunkLod<LodLevel::lod1>;
 template class ChunkLod<LodLevel::lod2>;
 template class ChunkLod<LodLevel::lod3>;
 template class ChunkLod<LodLevel::lod4>;
-
-template <LodLevel level>
-const std::vector<Voxel> ChunkLod<level>::get_voxels() const {
-  return voxels_;
-}
\ No newline at end of file
@@ -14,6 +14,11 @@ enum class LodLevel {
   lod4,
 };
 
+/*
+  A chunk at a coarser level of detail, each voxel standing in for a cube of
+  scale voxels on a side. Every level is built from the one below it, lod1
+  from the chunk itself, so the whole cascade costs little more than lod1.
+*/
 template <LodLevel Level>
 class ChunkLod {
 public:
@@ -23,19 +28,21 @@ public:
     : (Level == LodLevel::lod3) ? 8
                                 : 16;
   static constexpr int sz_x = common::chunk_sz_x / scale;
+  static constexpr int sz_y = common::chunk_sz_y / scale;
   static constexpr int sz_z = common::chunk_sz_z / scale;
-  static constexpr int sz_y = common::chunk_sz_y;
   static constexpr int sz = sz_x * sz_y * sz_z;
 
   ChunkLod() = default;
+  // Downsamples the voxels of the next finer level, the chunk's own for lod1
   ChunkLod(const std::vector<Voxel>& voxels);
+  // Uniform lods keep a single voxel
+  ChunkLod(Voxel voxel);
   Voxel get_voxel(int x, int y, int z) const;
-  const std::vector<Voxel> get_voxels() const;
+  const std::vector<Voxel>& get_voxels() const;
+  bool is_uniform() const;
 
 private:
   std::vector<Voxel> voxels_;
-
-  int vi(int x, int y, int z);
 };
 
 #endif
\ No newline at end of file
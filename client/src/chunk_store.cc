@@ -0,0 +1,16 @@
+#include "chunk_store.h"
+
+#include "region_chunk_store.h"
+#include "sqlite_chunk_store.h"
+
+std::unique_ptr<ChunkStore> ChunkStore::create(Backend backend, const std::string& dir) {
+  if (backend == Backend::region_files)
+    return std::make_unique<RegionChunkStore>(dir + "/regions");
+  return std::make_unique<SqliteChunkStore>(dir + "/db.sqlite");
+}
+
+StoredChunk ChunkStore::decode(const Location& loc, const unsigned char* data, int data_size) {
+  if (ChunkEdits::is_edit_log(data, data_size))
+    return StoredChunk(std::in_place_type<ChunkEdits>, loc, data, data_size);
+  return StoredChunk(std::in_place_type<Chunk>, loc, data, data_size);
+}
@@ -0,0 +1,41 @@
+#ifndef CHUNK_STORE_H
+#define CHUNK_STORE_H
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+#include "chunk.h"
+#include "chunk_edits.h"
+#include "types.h"
+
+// A saved chunk, or the edits to make to the chunk the generator makes there
+using StoredChunk = std::variant<Chunk, ChunkEdits>;
+
+/*
+  Where saved chunks live on disk, as blobs made by Chunk::encode or
+  ChunkEdits::encode. load is
+  never called from two threads at once, and neither is store, but a load can
+  run while a store is under way and sees each chunk either before or after it.
+*/
+class ChunkStore {
+public:
+  enum class Backend {
+    sqlite,
+    region_files
+  };
+  using Batch = std::unordered_map<Location, std::vector<unsigned char>, LocationHash>;
+
+  // Opens the chunks kept in dir with the given backend, creating them if needed
+  static std::unique_ptr<ChunkStore> create(Backend backend, const std::string& dir);
+  static StoredChunk decode(const Location& loc, const unsigned char* data, int data_size);
+
+  virtual ~ChunkStore() = default;
+  virtual std::optional<StoredChunk> load(const Location& loc) = 0;
+  virtual void store(const Batch& batch) = 0;
+  virtual std::vector<Location> get_locations() = 0;
+};
+
+#endif
@@ -5,6 +5,11 @@ namespace cs_math {
   constexpr int mod(int n, int m) {
     return ((n % m) + m) % m;
   }
+
+  // n / m rounded down rather than towards zero
+  constexpr int floor_div(int n, int m) {
+    return n / m - (n % m != 0 && (n < 0) != (m < 0));
+  }
 } // namespace Math
 
 #endif
\ No newline at end of file
@@ -1,108 +1,181 @@
 #include "db_manager.h"
 
-#include <filesystem>
+#include <iostream>
+#include <stdexcept>
 #include <string>
 #include <vector>
 #include "common.h"
+#include "sqlite_chunk_store.h"
 
-DbManager::DbManager() {
-  auto path = common::get_data_dir() + std::string("/db.sqlite");
-  bool initialize_db = false;
-  std::filesystem::path fs_path(path);
-  if (!std::filesystem::exists(fs_path)) {
-    initialize_db = true;
-  }
+ChunkStore::Backend DbManager::chunk_backend = ChunkStore::Backend::sqlite;
+bool DbManager::edit_log = true;
 
-  int failure = sqlite3_open(path.c_str(), &db_);
+DbManager::DbManager() {
+  auto dir = common::get_data_dir();
+  db_ = SqliteChunkStore::open(dir + "/db.sqlite");
+  std::string sql =
+    "create table if not exists Player("
+    "\tx real not null,"
+    "\ty real not null,"
+    "\tz real not null,"
+    "\tyaw real not null,"
+    "\tpitch real not null"
+    ");"
+    "insert into Player select 0,0,0,0,0 where not exists (select * from Player);";
+  char* err_msg;
+  int failure = sqlite3_exec(db_, sql.c_str(), NULL, 0, &err_msg);
   if (failure) {
-    std::cerr << "Failed to open database: " << sqlite3_errmsg(db_) << std::endl;
+    std::cerr << "Failed to create table: " << err_msg << std::endl;
+    sqlite3_free(err_msg);
     throw std::runtime_error("Failed to initialize DbManager");
   }
-  if (initialize_db) {
-    std::string chunk_table =
-      "create table Chunk("
-      "\tx integer not null,"
-      "\ty integer not null,"
-      "\tz integer not null,"
-      "\tdata blob,"
-      "\tprimary key (x,y,z)"
-      ");";
-    std::string player_table =
-      "create table Player("
-      "\tx real not null,"
-      "\ty real not null,"
-      "\tz real not null,"
-      "\tyaw real not null,"
-      "\tpitch real not null"
-      ");";
-    std::string player_entry =
-      "insert into Player values (0,0,0,0,0);";
-    std::string sql = chunk_table + player_table + player_entry;
-    char* err_msg;
-    int failure = sqlite3_exec(db_, sql.c_str(), NULL, 0, &err_msg);
-    if (failure) {
-      std::cerr << "Failed to create table: " << err_msg << std::endl;
-      sqlite3_free(err_msg);
-      throw std::runtime_error("Failed to initialize DbManager");
-    }
-  }
+
+  store_ = ChunkStore::create(chunk_backend, dir);
+  writer_ = std::thread(&DbManager::write_behind, this);
+  loader_ = std::thread(&DbManager::load_ahead, this);
 }
 
+// Writes whatever is still queued before closing
 DbManager::~DbManager() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    stopping_ = true;
+  }
+  cv_.notify_one();
+  loader_cv_.notify_one();
+  writer_.join();
+  loader_.join();
+  store_.reset();
   sqlite3_close(db_);
 }
 
-std::optional<Chunk> DbManager::load_chunk_if_exists(const Location& loc) {
-  sqlite3_stmt* stmt;
-  std::string sql = "select data from Chunk where x = ? and y = ? and z = ?";
-  sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
-  sqlite3_bind_int(stmt, 1, loc[0]);
-  sqlite3_bind_int(stmt, 2, loc[1]);
-  sqlite3_bind_int(stmt, 3, loc[2]);
-  int rc = sqlite3_step(stmt);
-  if (rc == SQLITE_ROW) {
-    const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(stmt, 0));
-    int data_size = sqlite3_column_bytes(stmt, 0);
-    auto chunk = Chunk(loc, data, data_size);
-    sqlite3_finalize(stmt);
-    return chunk;
-  } else {
-    sqlite3_finalize(stmt);
-    return {};
+// Reads the latest save of loc, which may still be queued. mutex_ is only held
+// to look in the queue, and save is set to the number of saves of loc at that
+// point so callers can tell if another lands before the read finishes.
+std::optional<StoredChunk> DbManager::load(const Location& loc, std::uint64_t& save) {
+  std::vector<unsigned char> blob;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    save = get_saves(loc);
+    if (auto it = pending_.find(loc); it != pending_.end())
+      blob = it->second;
+    else if (auto it = writing_.find(loc); it != writing_.end())
+      blob = it->second;
+  }
+  if (!blob.empty())
+    return ChunkStore::decode(loc, blob.data(), blob.size());
+
+  std::unique_lock<std::mutex> lock(load_mutex_);
+  return store_->load(loc);
+}
+
+// Expects mutex_ to be held
+std::uint64_t DbManager::get_saves(const Location& loc) const {
+  auto it = saves_.find(loc);
+  return it == saves_.end() ? 0 : it->second;
+}
+
+// Replaces the locations waiting to be loaded with locs, to be loaded in
+// order. Loaded chunks that aren't in locs are dropped.
+void DbManager::prefetch(const std::vector<Location>& locs) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    std::unordered_set<Location, LocationHash> wanted(locs.begin(), locs.end());
+    std::erase_if(ready_, [&wanted](const auto& entry) { return !wanted.contains(entry.first); });
+    to_load_.clear();
+    queued_.clear();
+    for (auto& loc : locs) {
+      if (!ready_.contains(loc) && queued_.insert(loc).second)
+        to_load_.push_back(loc);
+    }
+  }
+  loader_cv_.notify_one();
+}
+
+// Returns false until the loader has been to loc. After that chunk holds the
+// stored chunk, or nothing if there isn't one.
+bool DbManager::take_prefetched(const Location& loc, std::optional<StoredChunk>& chunk) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  auto it = ready_.find(loc);
+  if (it == ready_.end()) {
+    // never asked for, or dropped by a save, so it goes to the front
+    if (queued_.insert(loc).second) {
+      to_load_.push_front(loc);
+      loader_cv_.notify_one();
+    }
+    return false;
   }
+  chunk = std::move(it->second);
+  ready_.erase(it);
+  return true;
 }
 
 void DbManager::save_chunk(const Chunk& chunk) {
-  std::vector<std::uint32_t> runs;
-  auto& loc = chunk.get_location();
-  runs.reserve(Chunk::sz); // worst case
-  auto last_voxel = chunk.get_voxel(0, 0, 0);
-  std::uint32_t run_length = 0;
-  for (int y = 0; y < Chunk::sz_y; ++y) {
-    for (int x = 0; x < Chunk::sz_x; ++x) {
-      for (int z = 0; z < Chunk::sz_z; ++z) {
-        auto voxel = chunk.get_voxel(x, y, z);
-        if (voxel == last_voxel) {
-          ++run_length;
-        } else {
-          std::uint32_t run = (static_cast<std::uint32_t>(last_voxel) << 16) | run_length;
-          runs.push_back(run);
-          last_voxel = voxel;
-          run_length = 1;
-        }
-      }
+  queue_save(chunk.get_location(), chunk.encode());
+}
+
+void DbManager::save_chunk_edits(const ChunkEdits& edits) {
+  queue_save(edits.get_location(), edits.encode());
+}
+
+void DbManager::queue_save(const Location& loc, std::vector<unsigned char>&& blob) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    pending_[loc] = std::move(blob);
+    ++saves_[loc];
+    ready_.erase(loc);
+  }
+  cv_.notify_one();
+}
+
+// Blocks until every chunk saved so far is committed
+void DbManager::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  written_cv_.wait(lock, [this] { return pending_.empty() && writing_.empty(); });
+}
+
+void DbManager::write_behind() {
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+      if (pending_.empty())
+        return;
+      writing_.swap(pending_);
+    }
+    // only this thread changes writing_, so it can be read without the lock
+    store_->store(writing_);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      writing_.clear();
     }
+    written_cv_.notify_all();
+  }
+}
+
+// Reads and decodes with mutex_ released, so the game thread never waits on
+// the disk
+void DbManager::load_ahead() {
+  while (true) {
+    Location loc;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      loader_cv_.wait(lock, [this] { return stopping_ || !to_load_.empty(); });
+      if (stopping_)
+        return;
+      loc = to_load_.front();
+      to_load_.pop_front();
+      queued_.erase(loc);
+      if (ready_.contains(loc))
+        continue;
+    }
+    std::uint64_t save;
+    auto chunk = load(loc, save);
+    std::unique_lock<std::mutex> lock(mutex_);
+    // a save that landed during the read made it stale
+    if (get_saves(loc) == save && !ready_.contains(loc))
+      ready_.insert({loc, std::move(chunk)});
   }
-  std::string sql = "insert or replace into Chunk(x,y,z,data) values(?,?,?,?);";
-  sqlite3_stmt* stmt;
-  sqlite3_prepare_v2(db_, sql.c_str(), -1, &stmt, nullptr);
-  sqlite3_bind_int(stmt, 1, loc[0]);
-  sqlite3_bind_int(stmt, 2, loc[1]);
-  sqlite3_bind_int(stmt, 3, loc[2]);
-  int runs_size = sizeof(std::uint32_t) * runs.size();
-  sqlite3_bind_blob(stmt, 4, runs.data(), runs_size, SQLITE_STATIC);
-  sqlite3_step(stmt);
-  sqlite3_finalize(stmt);
 }
 
 void DbManager::load_camera(Camera& camera) {
@@ -1,22 +1,80 @@
 #ifndef DB_MANAGER_H
 #define DB_MANAGER_H
 
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <optional>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 #include <sqlite3.h>
 #include "chunk.h"
+#include "chunk_store.h"
 #include "camera.h"
 
+/*
+  Chunks and the camera, kept in the data directory. The camera is in a SQLite
+  database and chunks are in the ChunkStore picked by chunk_backend. With
+  edit_log on, chunks whose only changes from the generated terrain are a
+  few player edits should be saved with save_chunk_edits.
+  Chunk saves are written behind on a thread: saving only encodes the chunk
+  with Chunk::encode and queues it, saving a chunk again before it is written
+  replaces the queued copy, and everything queued is stored as one batch.
+  Loads see queued saves. flush() and the destructor wait for every queued
+  save to be written.
+  Chunks can also be loaded ahead on a loader thread: prefetch() hands it the
+  locations wanted next, in order, and take_prefetched() pops what it has
+  finished, decoded. Saving a chunk drops any copy of it already loaded.
+*/
 class DbManager {
 public:
   DbManager();
   ~DbManager();
   void save_chunk(const Chunk& chunk);
+  void save_chunk_edits(const ChunkEdits& edits);
+  void flush();
   void save_camera(const Camera& camera);
   void load_camera(Camera& camera);
-  std::optional<Chunk> load_chunk_if_exists(const Location& loc);
+  void prefetch(const std::vector<Location>& locs);
+  bool take_prefetched(const Location& loc, std::optional<StoredChunk>& chunk);
+  static ChunkStore::Backend chunk_backend;
+  static bool edit_log;
 
 private:
+  using Batch = ChunkStore::Batch;
+
+  std::optional<StoredChunk> load(const Location& loc, std::uint64_t& save);
+  std::uint64_t get_saves(const Location& loc) const;
+  void queue_save(const Location& loc, std::vector<unsigned char>&& blob);
+  void write_behind();
+  void load_ahead();
+
   sqlite3* db_;
+  std::unique_ptr<ChunkStore> store_;
+
+  Batch pending_;
+  // taken from pending_ by the writer and not yet committed
+  Batch writing_;
+  // times each location has been saved, to spot saves landing during a load
+  std::unordered_map<Location, std::uint64_t, LocationHash> saves_;
+  std::mutex mutex_;
+  // the store is read by one thread at a time
+  std::mutex load_mutex_;
+  std::condition_variable cv_;
+  std::condition_variable written_cv_;
+  // locations waiting for the loader, and the same as a set
+  std::deque<Location> to_load_;
+  std::unordered_set<Location, LocationHash> queued_;
+  // loaded chunks, or nothing where none is stored
+  std::unordered_map<Location, std::optional<StoredChunk>, LocationHash> ready_;
+  std::condition_variable loader_cv_;
+  bool stopping_ = false;
+  std::thread writer_;
+  std::thread loader_;
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,90 @@
+#ifndef EVICTION_INDEX_H
+#define EVICTION_INDEX_H
+
+#include <algorithm>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "types.h"
+
+/*
+  Set of locations bucketed by their whole distance to a centre, so the
+  farthest entry can be found without scanning or sorting. Buckets are only
+  rebuilt when the centre moves. Entries in the same bucket are within one unit
+  of each other and come out in no particular order. Everything at or past
+  max_bucket shares the last bucket.
+*/
+template <typename Key, typename Hash>
+class EvictionIndex {
+public:
+  explicit EvictionIndex(int max_bucket = 255) : buckets_(max_bucket + 1) {}
+
+  void set_center(const Key& center) {
+    if (center == center_)
+      return;
+    center_ = center;
+    for (auto& bucket : buckets_)
+      bucket.clear();
+    farthest_ = -1;
+    for (auto& [key, position] : positions_)
+      position = add_to_bucket(key);
+  }
+
+  void insert(const Key& key) {
+    if (positions_.contains(key))
+      return;
+    positions_.insert({key, add_to_bucket(key)});
+  }
+
+  void erase(const Key& key) {
+    auto it = positions_.find(key);
+    if (it == positions_.end())
+      return;
+    auto [bucket_idx, idx] = it->second;
+    auto& bucket = buckets_[bucket_idx];
+    if (idx != bucket.size() - 1) {
+      bucket[idx] = bucket.back();
+      positions_[bucket[idx]].second = idx;
+    }
+    bucket.pop_back();
+    positions_.erase(it);
+  }
+
+  bool contains(const Key& key) const {
+    return positions_.contains(key);
+  }
+
+  // Expects the index to be non-empty
+  Key pop_farthest() {
+    while (buckets_[farthest_].empty())
+      --farthest_;
+    Key key = buckets_[farthest_].back();
+    erase(key);
+    return key;
+  }
+
+  std::size_t size() const {
+    return positions_.size();
+  }
+
+  bool empty() const {
+    return positions_.empty();
+  }
+
+private:
+  std::pair<int, std::size_t> add_to_bucket(const Key& key) {
+    int bucket_idx = std::min(static_cast<int>(LocationMath::distance(key, center_)), static_cast<int>(buckets_.size()) - 1);
+    auto& bucket = buckets_[bucket_idx];
+    bucket.push_back(key);
+    farthest_ = std::max(farthest_, bucket_idx);
+    return {bucket_idx, bucket.size() - 1};
+  }
+
+  Key center_{};
+  std::vector<std::vector<Key>> buckets_;
+  std::unordered_map<Key, std::pair<int, std::size_t>, Hash> positions_;
+  // no bucket past this one holds anything
+  int farthest_ = -1;
+};
+
+#endif
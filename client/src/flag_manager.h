@@ -1,6 +1,8 @@
 #ifndef FLAG_MANAGER_H
 #define FLAG_MANAGER_H
 
+#include <cstdint>
+
 template <typename Flags>
 class FlagManager {
 public:
@@ -9,7 +11,7 @@ public:
   bool check_flag(Flags flag) const { return flags_ & static_cast<std::uint32_t>(flag); }
 
 protected:
-  std::uint32_t flags_;
+  std::uint32_t flags_ = 0;
 };
 
 #endif
\ No newline at end of file
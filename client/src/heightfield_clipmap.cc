@@ -0,0 +1,225 @@
+#include "heightfield_clipmap.h"
+#include <algorithm>
+#include <cstdlib>
+#include "cs_math.h"
+
+namespace {
+  // roughly the colour of each landcover's voxels from far away, in linear rgb
+  const std::array<glm::vec3, 9> landcover_colors = {{
+    {.32f, .29f, .25f}, // bare
+    {.05f, .12f, .2f},  // water
+    {.05f, .13f, .04f}, // trees
+    {.12f, .24f, .06f}, // grass
+    {.17f, .19f, .08f}, // shrubs
+    {.8f, .82f, .85f},  // snow
+    {.1f, .16f, .09f},  // wetland
+    {.06f, .14f, .07f}, // mangroves
+    {.16f, .2f, .11f},  // moss
+  }};
+
+  glm::vec3 get_color(const std::vector<common::LandCover>& landcover) {
+    std::array<int, landcover_colors.size()> counts{};
+    for (auto tile : landcover)
+      ++counts[static_cast<int>(tile)];
+    auto most_common = std::max_element(counts.begin(), counts.end()) - counts.begin();
+    return landcover_colors[most_common];
+  }
+}
+
+void HeightfieldClipmap::set_center(const Location2D& center) {
+  if (center == center_)
+    return;
+  center_ = center;
+  // the hole in level 0 follows the lods, which follow the centre itself
+  dirty_[0] = true;
+  for (int level = 0; level < num_levels; ++level) {
+    auto level_center = get_level_center(level);
+    if (level_center == level_centers_[level])
+      continue;
+    level_centers_[level] = level_center;
+    dirty_[level] = true;
+    // the level outside lost its hole
+    if (level + 1 < num_levels)
+      dirty_[level + 1] = true;
+  }
+  std::erase_if(samples_, [this](const auto& entry) {
+    for (int level = 0; level < num_levels; ++level) {
+      if (is_needed(level, entry.first))
+        return false;
+    }
+    return true;
+  });
+}
+
+void HeightfieldClipmap::add_sample(const Section& section) {
+  auto& loc = section.get_location();
+  if (samples_.contains(loc))
+    return;
+  bool needed = false;
+  for (int level = 0; level < num_levels; ++level) {
+    if (is_needed(level, loc)) {
+      dirty_[level] = true;
+      needed = true;
+    }
+  }
+  if (needed)
+    samples_.insert({loc, Sample{section.get_elevation(), get_color(section.get_landcover())}});
+}
+
+std::vector<Location2D> HeightfieldClipmap::get_missing_samples() const {
+  std::vector<Location2D> missing;
+  for (int level = 0; level < num_levels; ++level) {
+    auto& c = level_centers_[level];
+    int s = get_spacing(level);
+    int r = get_half_width(level);
+    for (int z = -r; z <= r; z += s) {
+      for (int x = -r; x <= r; x += s) {
+        Location2D loc{c[0] + x, c[1] + z};
+        // the edge of a level is also the edge of the hole in the next one
+        if (!is_needed(level, loc) || (level > 0 && is_needed(level - 1, loc)))
+          continue;
+        if (!samples_.contains(loc))
+          missing.push_back(loc);
+      }
+    }
+  }
+  return missing;
+}
+
+// Rebuilds the levels that moved or got new samples
+void HeightfieldClipmap::update() {
+  for (int level = 0; level < num_levels; ++level) {
+    if (dirty_[level]) {
+      build(level);
+      dirty_[level] = false;
+    }
+  }
+}
+
+std::vector<HeightfieldClipmap::LevelMesh>& HeightfieldClipmap::get_meshes() {
+  return meshes_;
+}
+
+void HeightfieldClipmap::clear_meshes() {
+  meshes_.clear();
+}
+
+Location2D HeightfieldClipmap::get_level_center(int level) const {
+  int step = 2 * get_spacing(level);
+  return Location2D{center_[0] - cs_math::mod(center_[0], step), center_[1] - cs_math::mod(center_[1], step)};
+}
+
+std::pair<Location2D, Location2D> HeightfieldClipmap::get_hole(int level) const {
+  if (level == 0)
+    return {Location2D{center_[0] - hole_distance, center_[1] - hole_distance},
+            Location2D{center_[0] + hole_distance, center_[1] + hole_distance}};
+  auto& c = level_centers_[level - 1];
+  int r = get_half_width(level - 1);
+  return {Location2D{c[0] - r, c[1] - r}, Location2D{c[0] + r, c[1] + r}};
+}
+
+bool HeightfieldClipmap::is_needed(int level, const Location2D& loc) const {
+  auto& c = level_centers_[level];
+  int s = get_spacing(level);
+  int r = get_half_width(level);
+  int dx = loc[0] - c[0];
+  int dz = loc[1] - c[1];
+  if (std::abs(dx) > r || std::abs(dz) > r || cs_math::mod(dx, s) != 0 || cs_math::mod(dz, s) != 0)
+    return false;
+  // samples on the edge of the hole are corners of cells outside it
+  auto [lo, hi] = get_hole(level);
+  return !(loc[0] > lo[0] && loc[0] < hi[0] && loc[1] > lo[1] && loc[1] < hi[1]);
+}
+
+void HeightfieldClipmap::build(int level) {
+  auto& c = level_centers_[level];
+  int s = get_spacing(level);
+  int r = get_half_width(level);
+  int n = 2 * r / s + 1;
+  auto [lo, hi] = get_hole(level);
+
+  std::vector<const Sample*> grid(n * n, nullptr);
+  std::vector<float> elevations(n * n, 0.f);
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      Location2D loc{c[0] - r + i * s, c[1] - r + j * s};
+      if (!is_needed(level, loc))
+        continue;
+      auto it = samples_.find(loc);
+      if (it == samples_.end())
+        continue;
+      grid[i + n * j] = &it->second;
+      elevations[i + n * j] = it->second.elevation;
+    }
+  }
+
+  // every other vertex on the outer edge falls mid-way along a cell edge of
+  // the next level, so it is pulled onto that edge to avoid cracks
+  auto pull_onto_edge = [&](int i, int j, int di, int dj) {
+    int a = (i - di) + n * (j - dj);
+    int b = (i + di) + n * (j + dj);
+    if (grid[a] != nullptr && grid[b] != nullptr)
+      elevations[i + n * j] = (elevations[a] + elevations[b]) / 2;
+  };
+  for (int k = 1; k < n - 1; k += 2) {
+    pull_onto_edge(k, 0, 1, 0);
+    pull_onto_edge(k, n - 1, 1, 0);
+    pull_onto_edge(0, k, 0, 1);
+    pull_onto_edge(n - 1, k, 0, 1);
+  }
+
+  // central differences, falling back to the vertex itself at gaps
+  std::vector<glm::vec3> normals(n * n);
+  float span = 2.f * s * Section::sz_x;
+  for (int j = 0; j < n; ++j) {
+    for (int i = 0; i < n; ++i) {
+      int idx = i + n * j;
+      if (grid[idx] == nullptr)
+        continue;
+      auto height = [&](int i, int j) {
+        if (i < 0 || i >= n || j < 0 || j >= n || grid[i + n * j] == nullptr)
+          return elevations[idx];
+        return elevations[i + n * j];
+      };
+      float dx = height(i + 1, j) - height(i - 1, j);
+      float dz = height(i, j + 1) - height(i, j - 1);
+      normals[idx] = glm::normalize(glm::vec3(-dx / span, 1.f, -dz / span));
+    }
+  }
+
+  LevelMesh level_mesh{level, c, {}};
+  auto& mesh = level_mesh.mesh;
+  mesh.reserve((n - 1) * (n - 1) * 6);
+  auto vertex = [&](int i, int j) {
+    int idx = i + n * j;
+    glm::vec3 position(
+      (i * s - r) * Section::sz_x + Section::sz_x / 2,
+      elevations[idx],
+      (j * s - r) * Section::sz_z + Section::sz_z / 2);
+    return HeightfieldVertex{position, normals[idx], grid[idx]->color};
+  };
+  for (int j = 0; j < n - 1; ++j) {
+    for (int i = 0; i < n - 1; ++i) {
+      int x = c[0] - r + i * s;
+      int z = c[1] - r + j * s;
+      if (x >= lo[0] && x + s <= hi[0] && z >= lo[1] && z + s <= hi[1])
+        continue;
+      int idx = i + n * j;
+      if (grid[idx] == nullptr || grid[idx + 1] == nullptr || grid[idx + n] == nullptr || grid[idx + n + 1] == nullptr)
+        continue;
+      auto v00 = vertex(i, j);
+      auto v10 = vertex(i + 1, j);
+      auto v01 = vertex(i, j + 1);
+      auto v11 = vertex(i + 1, j + 1);
+      // wound like the top faces of cubes and lods, so it faces up
+      mesh.insert(mesh.end(), {v00, v01, v10, v10, v01, v11});
+    }
+  }
+
+  // a level waiting to be drawn is replaced rather than drawn twice
+  auto it = std::find_if(meshes_.begin(), meshes_.end(), [level](auto& m) { return m.level == level; });
+  if (it != meshes_.end())
+    *it = std::move(level_mesh);
+  else
+    meshes_.push_back(std::move(level_mesh));
+}
@@ -0,0 +1,75 @@
+#ifndef HEIGHTFIELD_CLIPMAP_H
+#define HEIGHTFIELD_CLIPMAP_H
+
+#include <array>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <glm/glm.hpp>
+#include "lod_loader.h"
+#include "section.h"
+#include "types.h"
+
+/*
+  Far terrain past the lods, drawn as a heightfield with one vertex per
+  section, at the section's elevation and coloured by its landcover. Levels
+  are nested square rings like a geometry clipmap, each twice as wide and with
+  twice the spacing of the one inside it. A level's centre snaps to twice its
+  spacing so it is only rebuilt when the player crosses that grid, or when
+  samples it is waiting on arrive. Level 0 surrounds the lods and overlaps the
+  outer half of their last ring so no gap opens between the two.
+*/
+class HeightfieldClipmap {
+public:
+  struct LevelMesh {
+    int level;
+    Location2D center;
+    std::vector<HeightfieldVertex> mesh;
+  };
+
+  static constexpr int num_levels = 4;
+  // half the width of level 0, in sections, doubling with every level
+  static constexpr int half_width = 32;
+  // sections inside this distance of the centre are covered by lods, out to
+  // the last ring of them drawn
+  static constexpr int hole_distance = LodLoader::ring_distances.back();
+  // cells on the edge of the hole start at the centres of its sections
+  static_assert(hole_distance <= LodLoader::ring_distances.back(), "level 0 must overlap the last ring of lods drawn");
+  static_assert(half_width > hole_distance + 1, "level 0 must surround the lods");
+
+  static constexpr int get_spacing(int level) {
+    return 1 << level;
+  }
+
+  static constexpr int get_half_width(int level) {
+    return half_width << level;
+  }
+
+  void set_center(const Location2D& center);
+  void add_sample(const Section& section);
+  // sections the levels need that haven't been added
+  std::vector<Location2D> get_missing_samples() const;
+  void update();
+  std::vector<LevelMesh>& get_meshes();
+  void clear_meshes();
+
+private:
+  struct Sample {
+    int elevation;
+    glm::vec3 color;
+  };
+
+  Location2D get_level_center(int level) const;
+  // corners of the square drawn by the level inside, or by the lods for level 0
+  std::pair<Location2D, Location2D> get_hole(int level) const;
+  bool is_needed(int level, const Location2D& loc) const;
+  void build(int level);
+
+  Location2D center_{};
+  std::array<Location2D, num_levels> level_centers_{};
+  std::array<bool, num_levels> dirty_ = {true, true, true, true};
+  std::unordered_map<Location2D, Sample, Location2DHash> samples_;
+  std::vector<LevelMesh> meshes_;
+};
+
+#endif
@@ -0,0 +1,48 @@
+#include "job_system.h"
+#include <algorithm>
+
+JobSystem::JobSystem() {
+  int num_workers = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) - 1);
+  for (int i = 0; i < num_workers; ++i)
+    workers_.emplace_back(&JobSystem::run, this, i);
+}
+
+void JobSystem::submit(Job job) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    jobs_.push(std::move(job));
+  }
+  cv_.notify_one();
+}
+
+int JobSystem::get_num_workers() const {
+  return workers_.size();
+}
+
+// Finishes the jobs already submitted and joins the workers
+void JobSystem::stop() {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (stopping_)
+      return;
+    stopping_ = true;
+  }
+  cv_.notify_all();
+  for (auto& worker : workers_)
+    worker.join();
+}
+
+void JobSystem::run(int worker) {
+  while (true) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this] { return stopping_ || !jobs_.empty(); });
+      if (jobs_.empty())
+        return;
+      job = std::move(jobs_.front());
+      jobs_.pop();
+    }
+    job(worker);
+  }
+}
@@ -0,0 +1,74 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include "readerwriterqueue.h"
+
+/*
+  Pool of worker threads for background work such as meshing. Jobs are told
+  which worker runs them so they can report back through a CompletionQueue
+  without any locking.
+*/
+class JobSystem final {
+public:
+  using Job = std::function<void(int worker)>;
+
+  static JobSystem* instance() {
+    static JobSystem* instance = new JobSystem();
+    return instance;
+  }
+
+  JobSystem(const JobSystem& other) = delete;
+  JobSystem* operator=(const JobSystem* other) = delete;
+
+  void submit(Job job);
+  int get_num_workers() const;
+  void stop();
+
+private:
+  JobSystem();
+  void run(int worker);
+
+  std::vector<std::thread> workers_;
+  std::queue<Job> jobs_;
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopping_ = false;
+};
+
+// One single-producer queue per worker, drained by a single consumer thread
+template <typename T>
+class CompletionQueue {
+public:
+  CompletionQueue() {
+    int num_workers = JobSystem::instance()->get_num_workers();
+    for (int i = 0; i < num_workers; ++i)
+      queues_.push_back(std::make_unique<moodycamel::ReaderWriterQueue<T>>());
+  }
+
+  void push(int worker, T&& item) {
+    queues_[worker]->enqueue(std::move(item));
+  }
+
+  bool try_pop(T& item) {
+    for (std::size_t i = 0; i < queues_.size(); ++i) {
+      auto& queue = queues_[next_];
+      next_ = (next_ + 1) % queues_.size();
+      if (queue->try_dequeue(item))
+        return true;
+    }
+    return false;
+  }
+
+private:
+  std::vector<std::unique_ptr<moodycamel::ReaderWriterQueue<T>>> queues_;
+  std::size_t next_ = 0;
+};
+
+#endif
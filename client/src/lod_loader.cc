@@ -1,4 +1,7 @@
 #include "lod_loader.h"
+#include <algorithm>
+#include <cstdlib>
+#include "voxel.h"
 
 bool LodLoader::has_lods(const Location& loc) const {
   return lods_.contains(loc);
@@ -6,12 +9,27 @@ bool LodLoader::has_lods(const Location& loc) const {
 
 void LodLoader::create_lods(const Chunk& chunk) {
   auto& loc = chunk.get_location();
-  auto& voxels = chunk.get_voxels();
-  auto l1 = ChunkLod<LodLevel::lod1>(voxels);
-  auto lod_pack = LodPack{std::move(l1)};
-  lods_.insert({loc, std::move(lod_pack)});
+  LodPack lod_pack;
+  if (chunk.is_uniform()) {
+    // what ChunkLod makes of it, blocks without cubes being empty
+    auto voxel = vops::is_cube(chunk.get_uniform_voxel()) ? chunk.get_uniform_voxel() : Voxel::empty;
+    lod_pack = LodPack{voxel, voxel, voxel, voxel};
+  } else {
+    lod_pack.l1 = ChunkLod<LodLevel::lod1>(chunk.get_voxels());
+    lod_pack.l2 = ChunkLod<LodLevel::lod2>(lod_pack.l1.get_voxels());
+    lod_pack.l3 = ChunkLod<LodLevel::lod3>(lod_pack.l2.get_voxels());
+    lod_pack.l4 = ChunkLod<LodLevel::lod4>(lod_pack.l3.get_voxels());
+  }
 
+  auto [it, inserted] = lods_.insert_or_assign(loc, std::move(lod_pack));
   auto adjacent = LocationMath::get_adjacent_locations(loc);
+  if (!inserted) {
+    // an edited chunk, its neighbours' borders are read from it too
+    remesh(loc);
+    for (auto& location : adjacent)
+      remesh(location);
+    return;
+  }
 
   for (auto& location : adjacent) {
     if (!adjacents_missing_.contains(location))
@@ -19,22 +37,107 @@ void LodLoader::create_lods(const Chunk& chunk) {
     else
       --adjacents_missing_[location];
 
-    if (adjacents_missing_[location] == 0 && lods_.contains(location)) {
-      diffs_.emplace_back(location, Diff::creation);
-    }
+    if (adjacents_missing_[location] == 0 && lods_.contains(location))
+      update_level(location);
   }
 
-  if (!adjacents_missing_.contains(loc)) {
+  if (!adjacents_missing_.contains(loc))
     adjacents_missing_.insert({loc, 6});
-  } else if (
-    adjacents_missing_[loc] == 0) {
-    diffs_.emplace_back(loc, Diff::creation);
+  else if (adjacents_missing_[loc] == 0)
+    update_level(loc);
+}
+
+std::optional<LodLevel> LodLoader::get_level(const Location& loc) const {
+  int d = std::max(std::abs(loc[0] - center_[0]), std::abs(loc[2] - center_[2]));
+  if (d <= full_detail_distance)
+    return std::nullopt;
+  for (std::size_t i = 0; i < ring_distances.size(); ++i) {
+    if (d <= ring_distances[i])
+      return static_cast<LodLevel>(i);
+  }
+  return std::nullopt;
+}
+
+// Brings the level loc is drawn at up to date, returning whether it changed
+bool LodLoader::update_level(const Location& loc) {
+  std::optional<LodLevel> level;
+  auto missing = adjacents_missing_.find(loc);
+  if (lods_.contains(loc) && missing != adjacents_missing_.end() && missing->second == 0)
+    level = get_level(loc);
+
+  auto it = drawn_.find(loc);
+  if (it == drawn_.end()) {
+    if (!level)
+      return false;
+    drawn_.insert({loc, *level});
+    diffs_.push_back(Diff{loc, Diff::creation, *level});
+    return true;
+  }
+  if (level == it->second)
+    return false;
+  if (level) {
+    it->second = *level;
+    diffs_.push_back(Diff{loc, Diff::creation, *level});
+  } else {
+    drawn_.erase(it);
+    diffs_.push_back(Diff{loc, Diff::deletion});
+  }
+  return true;
+}
+
+void LodLoader::remesh(const Location& loc) {
+  auto it = drawn_.find(loc);
+  if (it != drawn_.end())
+    diffs_.push_back(Diff{loc, Diff::creation, it->second});
+}
+
+void LodLoader::erase(const Location& loc) {
+  lods_.erase(loc);
+  update_level(loc);
+  for (auto& location : LocationMath::get_adjacent_locations(loc)) {
+    auto it = adjacents_missing_.find(location);
+    if (it == adjacents_missing_.end())
+      continue;
+    if (++it->second == 6 && !lods_.contains(location))
+      adjacents_missing_.erase(it);
+    else
+      update_level(location);
+  }
+}
+
+// Drops the lods that are now out of range and moves the rest between rings.
+// A lod next to one that changed level is remeshed, as its seam changes.
+void LodLoader::set_center(const Location& center) {
+  if (center == center_)
+    return;
+  center_ = center;
+
+  std::vector<Location> out_of_range;
+  for (auto& [loc, lod_pack] : lods_) {
+    int d = std::max(std::abs(loc[0] - center_[0]), std::abs(loc[2] - center_[2]));
+    if (d > ring_distances.back() + 1 || std::abs(loc[1] - center_[1]) > max_dy + 1)
+      out_of_range.push_back(loc);
+  }
+  for (auto& loc : out_of_range)
+    erase(loc);
+
+  std::vector<Location> changed;
+  for (auto& [loc, lod_pack] : lods_) {
+    if (update_level(loc))
+      changed.push_back(loc);
+  }
+  for (auto& loc : changed) {
+    for (auto& location : LocationMath::get_adjacent_locations(loc)) {
+      if (location[1] == loc[1])
+        remesh(location);
+    }
   }
 }
 
 const std::vector<LodLoader::Diff>& LodLoader::get_diffs() const {
   return diffs_;
 }
+
 void LodLoader::clear_diffs() {
   diffs_.clear();
 }
@@ -50,24 +153,28 @@ std::array<const ChunkLod<level>*, 6> LodLoader::get_adjacent_lods(const Locatio
     &lods_.at(Location{loc[0], loc[1], loc[2] + 1}).get<level>()};
 }
 
-template std::array<const ChunkLod<LodLevel::lod1>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod1>(const Location& loc) const;
-template std::array<const ChunkLod<LodLevel::lod2>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod2>(const Location& loc) const;
-
 template <LodLevel level>
 const ChunkLod<level>& LodLoader::LodPack::get() const {
   if constexpr (level == LodLevel::lod1)
     return l1;
   else if constexpr (level == LodLevel::lod2)
     return l2;
+  else if constexpr (level == LodLevel::lod3)
+    return l3;
+  else
+    return l4;
 }
 
 template <LodLevel level>
 const ChunkLod<level>& LodLoader::get_lod(const Location& loc) const {
-  if constexpr (level == LodLevel::lod1)
-    return lods_.at(loc).l1;
-  else if constexpr (level == LodLevel::lod2)
-    return lods_.at(loc).l2;
+  return lods_.at(loc).get<level>();
 }
 
 template const ChunkLod<LodLevel::lod1>& LodLoader::get_lod<LodLevel::lod1>(const Location& loc) const;
-template const ChunkLod<LodLevel::lod2>& LodLoader::get_lod<LodLevel::lod2>(const Location& loc) const;
\ No newline at end of file
+template const ChunkLod<LodLevel::lod2>& LodLoader::get_lod<LodLevel::lod2>(const Location& loc) const;
+template const ChunkLod<LodLevel::lod3>& LodLoader::get_lod<LodLevel::lod3>(const Location& loc) const;
+template const ChunkLod<LodLevel::lod4>& LodLoader::get_lod<LodLevel::lod4>(const Location& loc) const;
+template std::array<const ChunkLod<LodLevel::lod1>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod1>(const Location& loc) const;
+template std::array<const ChunkLod<LodLevel::lod2>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod2>(const Location& loc) const;
+template std::array<const ChunkLod<LodLevel::lod3>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod3>(const Location& loc) const;
+template std::array<const ChunkLod<LodLevel::lod4>*, 6> LodLoader::get_adjacent_lods<LodLevel::lod4>(const Location& loc) const;
@@ -1,24 +1,38 @@
 #ifndef LOD_LOADER_H
 #define LOD_LOADER_H
 
+#include <array>
+#include <optional>
 #include <unordered_map>
 #include <vector>
 #include "chunk.h"
 #include "chunk_lod.h"
 #include "types.h"
 
+/*
+  Keeps the lods of chunks around a centre, usually the player's chunk, and
+  decides which level each is drawn at. Levels are drawn in square rings past
+  full_detail_distance, lod1 closest, and a lod is only drawn once all six of
+  its neighbours have lods. Creation diffs ask for a lod to be (re)meshed at a
+  level, deletion diffs for it to stop being drawn.
+*/
 class LodLoader {
 public:
   struct Diff {
     enum Kind {
       creation,
+      deletion,
     };
     Location location;
     Kind kind;
+    LodLevel level = LodLevel::lod1;
   };
 
   void create_lods(const Chunk& chunk);
   bool has_lods(const Location& loc) const;
+  void set_center(const Location& center);
+  // the level loc is drawn at from the current centre, none inside full detail and past the last ring
+  std::optional<LodLevel> get_level(const Location& loc) const;
   const std::vector<Diff>& get_diffs() const;
   void clear_diffs();
   template <LodLevel level>
@@ -26,20 +40,42 @@ public:
   template <LodLevel level>
   std::array<const ChunkLod<level>*, 6> get_adjacent_lods(const Location& loc) const;
 
-  static constexpr int lod1_sz = 4096;
+  // chunks this close to the centre, horizontally, are drawn at full detail
+  static constexpr int full_detail_distance = 3;
+  // outer edge of the ring each level is drawn in
+  static constexpr std::array<int, 4> ring_distances = {8, 12, 16, 24};
+  // lods are kept this many chunks above and below the centre
+  static constexpr int max_dy = 2;
+
+  // most lods ever drawn at a level
+  static constexpr int max_meshes(LodLevel level) {
+    int i = static_cast<int>(level);
+    int inner = i == 0 ? full_detail_distance : ring_distances[i - 1];
+    int outer = ring_distances[i];
+    return ((2 * outer + 1) * (2 * outer + 1) - (2 * inner + 1) * (2 * inner + 1)) * (2 * max_dy + 1);
+  }
 
 private:
   struct LodPack {
     ChunkLod<LodLevel::lod1> l1;
     ChunkLod<LodLevel::lod2> l2;
+    ChunkLod<LodLevel::lod3> l3;
+    ChunkLod<LodLevel::lod4> l4;
 
     template <LodLevel level>
     const ChunkLod<level>& get() const;
   };
 
+  bool update_level(const Location& loc);
+  void remesh(const Location& loc);
+  void erase(const Location& loc);
+
   std::unordered_map<Location, LodPack, LocationHash> lods_;
   std::unordered_map<Location, int, LocationHash> adjacents_missing_;
+  // level each lod is being drawn at
+  std::unordered_map<Location, LodLevel, LocationHash> drawn_;
   std::vector<Diff> diffs_;
+  Location center_{};
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -1,50 +1,59 @@
 #include "lod_mesh_generator.h"
 #include "mesh_utils.h"
 
+// Copies the lod and the faces of its neighbours touching it into one padded
+// buffer. A neighbour drawn at another level, or at full detail, doesn't line
+// up with this lod, so its border is left empty and the faces along it are
+// kept as a skirt hiding the seam.
 template <LodLevel level>
-std::array<Voxel, 6> LodMeshGenerator::get_adjacent_voxels(
-  const ChunkLod<level>& lod, std::array<const ChunkLod<level>*, 6>& adjacent_lods, int x, int y, int z) {
-  std::array<Voxel, 6> adjacent;
-  if (x > 0)
-    adjacent[nx] = lod.get_voxel(x - 1, y, z);
-  else
-    adjacent[nx] = adjacent_lods[nx]->get_voxel(ChunkLod<level>::sz_x - 1, y, z);
-  if (x < ChunkLod<level>::sz_x - 1)
-    adjacent[px] = lod.get_voxel(x + 1, y, z);
-  else
-    adjacent[px] = adjacent_lods[px]->get_voxel(0, y, z);
-  if (y > 0)
-    adjacent[ny] = lod.get_voxel(x, y - 1, z);
-  else
-    adjacent[ny] = adjacent_lods[ny]->get_voxel(x, ChunkLod<level>::sz_y - 1, z);
-  if (y < ChunkLod<level>::sz_y - 1)
-    adjacent[py] = lod.get_voxel(x, y + 1, z);
-  else
-    adjacent[py] = adjacent_lods[py]->get_voxel(x, 0, z);
-  if (z > 0)
-    adjacent[nz] = lod.get_voxel(x, y, z - 1);
-  else
-    adjacent[nz] = adjacent_lods[nz]->get_voxel(x, y, ChunkLod<level>::sz_z - 1);
-  if (z < ChunkLod<level>::sz_z - 1)
-    adjacent[pz] = lod.get_voxel(x, y, z + 1);
-  else
-    adjacent[pz] = adjacent_lods[pz]->get_voxel(x, y, 0);
-  return adjacent;
+LodMeshGenerator::PaddedLod<level> LodMeshGenerator::pad_lod(const LodLoader& lod_loader, const Location& location) {
+  constexpr int sx = ChunkLod<level>::sz_x, sy = ChunkLod<level>::sz_y, sz = ChunkLod<level>::sz_z;
+  auto& lod = lod_loader.get_lod<level>(location);
+  auto adjacent_lods = lod_loader.get_adjacent_lods<level>(location);
+  auto adjacent = LocationMath::get_adjacent_locations(location);
+  std::array<bool, 6> same_level;
+  for (int d = 0; d < 6; ++d)
+    same_level[d] = lod_loader.get_level(adjacent[d]) == level;
+
+  PaddedLod<level> padded;
+  for (int z = 0; z < sz; ++z) {
+    for (int y = 0; y < sy; ++y) {
+      for (int x = 0; x < sx; ++x)
+        padded.set_voxel(x, y, z, lod.get_voxel(x, y, z));
+      if (same_level[nx])
+        padded.set_voxel(-1, y, z, adjacent_lods[nx]->get_voxel(sx - 1, y, z));
+      if (same_level[px])
+        padded.set_voxel(sx, y, z, adjacent_lods[px]->get_voxel(0, y, z));
+    }
+    for (int x = 0; x < sx; ++x) {
+      if (same_level[ny])
+        padded.set_voxel(x, -1, z, adjacent_lods[ny]->get_voxel(x, sy - 1, z));
+      if (same_level[py])
+        padded.set_voxel(x, sy, z, adjacent_lods[py]->get_voxel(x, 0, z));
+    }
+  }
+  for (int y = 0; y < sy; ++y) {
+    for (int x = 0; x < sx; ++x) {
+      if (same_level[nz])
+        padded.set_voxel(x, y, -1, adjacent_lods[nz]->get_voxel(x, y, sz - 1));
+      if (same_level[pz])
+        padded.set_voxel(x, y, sz, adjacent_lods[pz]->get_voxel(x, y, 0));
+    }
+  }
+  return padded;
 }
 
 template <LodLevel level>
-void LodMeshGenerator::mesh_chunk(LodLoader& lod_loader, const Location& location) {
-  auto& lod = lod_loader.get_lod<level>(location);
-
-  auto adjacent_lods = lod_loader.get_adjacent_lods<level>(location);
-  auto& mesh = meshes_[location].get<level>();
+std::vector<LodVertex> LodMeshGenerator::mesh_lod(const PaddedLod<level>& padded) {
+  std::vector<LodVertex> mesh;
   for (int z = 0; z < ChunkLod<level>::sz_z; ++z) {
     for (int y = 0; y < ChunkLod<level>::sz_y; ++y) {
-      for (int x = 0; x < ChunkLod<level>::sz_x; ++x) {
-        auto voxel = lod.get_voxel(x, y, z);
+      int i = PaddedLod<level>::get_index(0, y, z);
+      for (int x = 0; x < ChunkLod<level>::sz_x; ++x, ++i) {
+        auto voxel = padded.get_voxel(i);
         if (!vops::is_cube(voxel))
           continue;
-        auto adjacent = get_adjacent_voxels<level>(lod, adjacent_lods, x, y, z);
+        auto adjacent = padded.get_adjacent_voxels(i);
         auto voxel_textures = MeshUtils::get_textures(voxel, adjacent);
         auto& textures = reinterpret_cast<std::array<int, 6>&>(voxel_textures);
 
@@ -99,44 +108,93 @@ void LodMeshGenerator::mesh_chunk(LodLoader& lod_loader, const Location& locatio
       }
     }
   }
+  return mesh;
+}
+
+template <LodLevel level>
+std::vector<LodVertex> LodMeshGenerator::mesh_chunk(const LodLoader& lod_loader, const Location& location) {
+  return mesh_lod<level>(pad_lod<level>(lod_loader, location));
+}
+
+template <LodLevel level>
+void LodMeshGenerator::dispatch(const LodLoader& lod_loader, const Location& location) {
+  auto generation = next_generation_++;
+  generations_[location] = generation;
+  auto padded = std::make_shared<const PaddedLod<level>>(pad_lod<level>(lod_loader, location));
+  JobSystem::instance()->submit([this, padded, location, generation](int worker) {
+    completed_.push(worker, MeshResult{location, generation, level, mesh_lod<level>(*padded)});
+  });
 }
 
 void LodMeshGenerator::consume_lod_loader(LodLoader& lod_loader) {
-  auto& diffs = lod_loader.get_diffs();
-  for (auto& diff : diffs) {
+  // only the last diff for a lod matters
+  std::vector<LodLoader::Diff> latest;
+  std::unordered_map<Location, std::size_t, LocationHash> latest_idx;
+  for (auto& diff : lod_loader.get_diffs()) {
+    auto [it, inserted] = latest_idx.try_emplace(diff.location, latest.size());
+    if (inserted)
+      latest.push_back(diff);
+    else
+      latest[it->second] = diff;
+  }
+
+  for (auto& diff : latest) {
+    auto& loc = diff.location;
     if (diff.kind == LodLoader::Diff::creation) {
-      auto& loc = diff.location;
-      mesh_chunk<LodLevel::lod1>(lod_loader, loc);
-      diffs_.emplace_back(Diff::creation, loc, Diff::CreationData{LodLevel::lod1});
+      switch (diff.level) {
+      case LodLevel::lod1:
+        dispatch<LodLevel::lod1>(lod_loader, loc);
+        break;
+      case LodLevel::lod2:
+        dispatch<LodLevel::lod2>(lod_loader, loc);
+        break;
+      case LodLevel::lod3:
+        dispatch<LodLevel::lod3>(lod_loader, loc);
+        break;
+      case LodLevel::lod4:
+        dispatch<LodLevel::lod4>(lod_loader, loc);
+        break;
+      }
+    } else if (diff.kind == LodLoader::Diff::deletion) {
+      generations_.erase(loc);
+      meshes_.erase(loc);
+      diffs_.push_back(Diff{loc, Diff::deletion});
     }
   }
   lod_loader.clear_diffs();
+  collect_meshes();
 }
 
-void LodMeshGenerator::clear_diffs() {
-  diffs_.clear();
-}
-const std::vector<LodMeshGenerator::Diff>& LodMeshGenerator::get_diffs() const {
-  return diffs_;
+// Picks up meshes finished by the workers since the last call
+void LodMeshGenerator::collect_meshes() {
+  MeshResult result;
+  while (completed_.try_pop(result)) {
+    auto it = generations_.find(result.location);
+    if (it == generations_.end() || it->second != result.generation)
+      continue;
+    generations_.erase(it);
+    meshes_[result.location] = std::move(result.mesh);
+    diffs_.push_back(Diff{result.location, Diff::creation, result.level});
+  }
 }
 
-template <LodLevel level>
-const std::vector<LodVertex>& LodMeshGenerator::get_mesh(const Location& loc) const {
-  return meshes_.at(loc).get<level>();
+std::vector<LodVertex> LodMeshGenerator::take_mesh(const Location& loc) {
+  auto node = meshes_.extract(loc);
+  if (node.empty())
+    return {};
+  return std::move(node.mapped());
 }
 
-template const std::vector<LodVertex>& LodMeshGenerator::get_mesh<LodLevel::lod1>(const Location& loc) const;
-template const std::vector<LodVertex>& LodMeshGenerator::get_mesh<LodLevel::lod2>(const Location& loc) const;
+void LodMeshGenerator::clear_diffs() {
+  meshes_.clear();
+  diffs_.clear();
+}
 
-template <LodLevel level>
-std::vector<LodVertex>& LodMeshGenerator::MeshPack::get() {
-  if constexpr (level == LodLevel::lod1)
-    return l1;
-  else if constexpr (level == LodLevel::lod2)
-    return l2;
+const std::vector<LodMeshGenerator::Diff>& LodMeshGenerator::get_diffs() const {
+  return diffs_;
 }
 
-template <LodLevel level>
-const std::vector<LodVertex>& LodMeshGenerator::MeshPack::get() const {
-  return const_cast<MeshPack*>(this)->template get<level>();
-}
\ No newline at end of file
+template std::vector<LodVertex> LodMeshGenerator::mesh_chunk<LodLevel::lod1>(const LodLoader& lod_loader, const Location& location);
+template std::vector<LodVertex> LodMeshGenerator::mesh_chunk<LodLevel::lod2>(const LodLoader& lod_loader, const Location& location);
+template std::vector<LodVertex> LodMeshGenerator::mesh_chunk<LodLevel::lod3>(const LodLoader& lod_loader, const Location& location);
+template std::vector<LodVertex> LodMeshGenerator::mesh_chunk<LodLevel::lod4>(const LodLoader& lod_loader, const Location& location);
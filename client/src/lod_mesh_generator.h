@@ -1,55 +1,62 @@
 #ifndef LOD_MESH_GENERATOR_H
 #define LOD_MESH_GENERATOR_H
 
-#include <any>
+#include <array>
+#include <unordered_map>
 #include <vector>
+#include "job_system.h"
 #include "lod_loader.h"
+#include "padded_voxels.h"
 #include "types.h"
 
 class LodMeshGenerator {
 public:
   struct Diff {
-    struct CreationData {
-      LodLevel level;
-    };
     enum Kind {
       creation,
+      deletion,
     };
+    Location location;
     Kind kind;
+    LodLevel level = LodLevel::lod1;
+  };
+  struct MeshResult {
     Location location;
-    std::any data;
-
-    template <typename T>
-    Diff(Kind k, Location loc, const T& obj) : kind(k), location(loc), data(obj) {}
+    std::uint64_t generation;
+    LodLevel level;
+    std::vector<LodVertex> mesh;
   };
 
   void consume_lod_loader(LodLoader& lod_loader);
+  // Hands over the mesh of a lod created since the last clear_diffs
+  std::vector<LodVertex> take_mesh(const Location& loc);
   void clear_diffs();
   const std::vector<Diff>& get_diffs() const;
+
+  // Meshes a lod on the calling thread
   template <LodLevel level>
-  const std::vector<LodVertex>& get_mesh(const Location& loc) const;
+  static std::vector<LodVertex> mesh_chunk(const LodLoader& lod_loader, const Location& location);
+
+  static constexpr std::array<int, 4> defacto_vertices_per_lod_mesh = {3000, 1000, 300, 100};
 
-  static constexpr int defacto_vertices_per_lod1_mesh = 10000;
-  
 private:
-  struct MeshPack {
-    std::vector<LodVertex> l1;
-    std::vector<LodVertex> l2;
-
-    template <LodLevel level>
-    const std::vector<LodVertex>& get() const;
-    template <LodLevel level>
-    std::vector<LodVertex>& get();
-  };
+  template <LodLevel level>
+  using PaddedLod = PaddedVoxels<ChunkLod<level>::sz_x, ChunkLod<level>::sz_y, ChunkLod<level>::sz_z>;
 
   template <LodLevel level>
-  void mesh_chunk(LodLoader& lod_loader, const Location& location);
+  static PaddedLod<level> pad_lod(const LodLoader& lod_loader, const Location& location);
+  template <LodLevel level>
+  static std::vector<LodVertex> mesh_lod(const PaddedLod<level>& padded);
   template <LodLevel level>
-  std::array<Voxel, 6> get_adjacent_voxels(
-    const ChunkLod<level>& lod, std::array<const ChunkLod<level>*, 6>& adjacent_lods, int x, int y, int z);
+  void dispatch(const LodLoader& lod_loader, const Location& location);
+  void collect_meshes();
 
-  std::unordered_map<Location, MeshPack, LocationHash> meshes_;
+  std::unordered_map<Location, std::vector<LodVertex>, LocationHash> meshes_;
   std::vector<Diff> diffs_;
+  // latest meshing job dispatched for each lod, older results are dropped
+  std::unordered_map<Location, std::uint64_t, LocationHash> generations_;
+  std::uint64_t next_generation_ = 0;
+  CompletionQueue<MeshResult> completed_;
 };
 
-#endif
\ No newline at end of file
+#endif
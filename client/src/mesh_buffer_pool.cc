@@ -0,0 +1,50 @@
+#include "mesh_buffer_pool.h"
+
+template <typename T>
+std::vector<T> MeshBufferPool::acquire(std::vector<std::vector<T>>& free, std::size_t capacity) {
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!free.empty()) {
+      auto vector = std::move(free.back());
+      free.pop_back();
+      ++reused_;
+      return vector;
+    }
+    if (capacity > 0)
+      ++allocated_;
+  }
+  std::vector<T> vector;
+  vector.reserve(capacity);
+  return vector;
+}
+
+template <typename T>
+void MeshBufferPool::release(std::vector<std::vector<T>>& free, std::vector<T>&& vector) {
+  if (vector.capacity() == 0)
+    return;
+  vector.clear();
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (free.size() < max_free)
+    free.push_back(std::move(vector));
+}
+
+std::vector<CubeFace> MeshBufferPool::acquire_faces(std::size_t capacity) {
+  return acquire(free_faces_, capacity);
+}
+
+std::vector<Vertex> MeshBufferPool::acquire_vertices(std::size_t capacity) {
+  return acquire(free_vertices_, capacity);
+}
+
+void MeshBufferPool::release(std::vector<CubeFace>&& faces) {
+  release(free_faces_, std::move(faces));
+}
+
+void MeshBufferPool::release(std::vector<Vertex>&& vertices) {
+  release(free_vertices_, std::move(vertices));
+}
+
+MeshBufferPool::Stats MeshBufferPool::get_stats() const {
+  std::unique_lock<std::mutex> lock(mutex_);
+  return Stats{free_faces_.size(), free_vertices_.size(), reused_, allocated_};
+}
@@ -0,0 +1,56 @@
+#ifndef MESH_BUFFER_POOL_H
+#define MESH_BUFFER_POOL_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "types.h"
+
+/*
+  Keeps the vectors of meshes that have been uploaded so the next meshing pass
+  can fill them again instead of allocating. Vectors come back cleared but
+  with their capacity, and are shared between the meshing workers.
+*/
+class MeshBufferPool final {
+public:
+  struct Stats {
+    std::size_t free_faces;
+    std::size_t free_vertices;
+    std::uint64_t reused;
+    std::uint64_t allocated;
+  };
+
+  static MeshBufferPool* instance() {
+    static MeshBufferPool* instance = new MeshBufferPool();
+    return instance;
+  }
+
+  MeshBufferPool(const MeshBufferPool& other) = delete;
+  MeshBufferPool* operator=(const MeshBufferPool* other) = delete;
+
+  // Reuses a released vector if there is one, otherwise makes one with room
+  // for capacity elements
+  std::vector<CubeFace> acquire_faces(std::size_t capacity = 0);
+  std::vector<Vertex> acquire_vertices(std::size_t capacity = 0);
+  void release(std::vector<CubeFace>&& faces);
+  void release(std::vector<Vertex>&& vertices);
+  Stats get_stats() const;
+
+  // released vectors past this many of a kind are freed
+  static constexpr std::size_t max_free = 1024;
+
+private:
+  MeshBufferPool() = default;
+  template <typename T>
+  std::vector<T> acquire(std::vector<std::vector<T>>& free, std::size_t capacity);
+  template <typename T>
+  void release(std::vector<std::vector<T>>& free, std::vector<T>&& vector);
+
+  mutable std::mutex mutex_;
+  std::vector<std::vector<CubeFace>> free_faces_;
+  std::vector<std::vector<Vertex>> free_vertices_;
+  std::uint64_t reused_ = 0;
+  std::uint64_t allocated_ = 0;
+};
+
+#endif
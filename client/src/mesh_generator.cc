@@ -1,42 +1,19 @@
 #include "mesh_generator.h"
 #include <algorithm>
+#include <bit>
 #include <chrono>
 #include <cmath>
 #include <iostream>
 #include <glm/ext.hpp>
+#include "mesh_buffer_pool.h"
 #include "mesh_utils.h"
 
-MeshGenerator::MeshGenerator() {}
+static_assert(VoxelTextures::num_cube_textures <= CubeFace::max_textures, "cube textures don't fit in CubeFace");
 
-std::array<Voxel, 6> MeshGenerator::get_adjacent_voxels(
-  const Chunk& chunk, std::array<const Chunk*, 6>& adjacent_chunks, int x, int y, int z) const {
-  std::array<Voxel, 6> adjacent;
-  if (x > 0)
-    adjacent[nx] = chunk.get_voxel(x - 1, y, z);
-  else
-    adjacent[nx] = adjacent_chunks[nx]->get_voxel(Chunk::sz_x - 1, y, z);
-  if (x < Chunk::sz_x - 1)
-    adjacent[px] = chunk.get_voxel(x + 1, y, z);
-  else
-    adjacent[px] = adjacent_chunks[px]->get_voxel(0, y, z);
-  if (y > 0)
-    adjacent[ny] = chunk.get_voxel(x, y - 1, z);
-  else
-    adjacent[ny] = adjacent_chunks[ny]->get_voxel(x, Chunk::sz_y - 1, z);
-  if (y < Chunk::sz_y - 1)
-    adjacent[py] = chunk.get_voxel(x, y + 1, z);
-  else
-    adjacent[py] = adjacent_chunks[py]->get_voxel(x, 0, z);
-  if (z > 0)
-    adjacent[nz] = chunk.get_voxel(x, y, z - 1);
-  else
-    adjacent[nz] = adjacent_chunks[nz]->get_voxel(x, y, Chunk::sz_z - 1);
-  if (z < Chunk::sz_z - 1)
-    adjacent[pz] = chunk.get_voxel(x, y, z + 1);
-  else
-    adjacent[pz] = adjacent_chunks[pz]->get_voxel(x, y, 0);
-  return adjacent;
-}
+std::atomic<bool> MeshGenerator::greedy_meshing = true;
+std::atomic<bool> MeshGenerator::bitmask_meshing = true;
+
+MeshGenerator::MeshGenerator() {}
 
 void MeshGenerator::mesh_noncube(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel) {
   float i = position[0], j = position[1], k = position[2];
@@ -156,33 +133,149 @@ void MeshGenerator::mesh_water(std::vector<Vertex>& mesh, glm::vec3& position, V
     }*/
 }
 
-void MeshGenerator::mesh_chunk(const Region& region, const Location& location) {
-  auto& chunk = region.get_chunk(location);
+// Grows each face into the largest rectangle of faces in the same slice with
+// the same texture, first along one axis of the slice and then the other.
+// Rectangles don't cross from one slab into the next.
+void MeshGenerator::merge_faces(MeshResult& result, std::vector<std::uint8_t>& faces) {
+  constexpr int n = Chunk::sz_x;
+  for (int d = 0; d < 6; ++d) {
+    int normal_axis = d / 2;
+    int a = normal_axis == 0 ? 1 : 0;
+    int b = normal_axis == 2 ? 1 : 2;
+    auto* direction_faces = &faces[d * Chunk::sz];
+    auto face = [direction_faces, normal_axis, a, b](int s, int i, int j) -> std::uint8_t& {
+      Int3D coord;
+      coord[normal_axis] = s;
+      coord[a] = i;
+      coord[b] = j;
+      return direction_faces[Chunk::get_index(coord)];
+    };
+
+    auto slabs = result.slabs;
+    for (int s = 0; s < n; ++s) {
+      if (normal_axis == 1 && !Chunk::in_slabs(slabs, s))
+        continue;
+      for (int j = 0; j < n; ++j) {
+        if (b == 1 && !Chunk::in_slabs(slabs, j))
+          continue;
+        for (int i = 0; i < n; ++i) {
+          if (a == 1 && !Chunk::in_slabs(slabs, i))
+            continue;
+          auto key = face(s, i, j);
+          if (key == 0)
+            continue;
+
+          // the y axis stops at the end of the slab
+          int end_i = a == 1 ? (i / Chunk::slab_sz_y + 1) * Chunk::slab_sz_y : n;
+          int end_j = b == 1 ? (j / Chunk::slab_sz_y + 1) * Chunk::slab_sz_y : n;
+          int width = 1;
+          while (i + width < end_i && width < CubeFace::max_size && face(s, i + width, j) == key)
+            ++width;
+          int height = 1;
+          while (j + height < end_j && height < CubeFace::max_size) {
+            int k = 0;
+            while (k < width && face(s, i + k, j + height) == key)
+              ++k;
+            if (k < width)
+              break;
+            ++height;
+          }
+          for (int h = 0; h < height; ++h) {
+            for (int w = 0; w < width; ++w)
+              face(s, i + w, j + h) = 0;
+          }
+
+          Int3D corner;
+          corner[normal_axis] = s;
+          corner[a] = i;
+          corner[b] = j;
+          auto& mesh = result.slab_meshes[corner[1] / Chunk::slab_sz_y].mesh;
+          mesh.emplace_back(corner[0], corner[1], corner[2], static_cast<Direction>(d), width, height, key - 1);
+        }
+      }
+    }
+  }
+}
+
+MeshGenerator::ChunkSnapshot MeshGenerator::take_snapshot(const Region& region, const Location& location, const Location& origin) {
+  static_assert(Chunk::sz_x == Chunk::sz_y && Chunk::sz_y == Chunk::sz_z, "border slices assume cubic chunks");
   auto adjacent_chunks = region.get_adjacent_chunks(location);
-  auto& mesh = meshes_[location];
-  auto& irregular_mesh = irregular_meshes_[location];
-  auto& water_mesh = water_meshes_[location];
-  mesh.reserve(defacto_vertices_per_mesh);
-  glm::vec3 chunk_position(
-    (location[0] - origin_[0]) * Chunk::sz_x, (location[1] - origin_[1]) * Chunk::sz_y, (location[2] - origin_[2]) * Chunk::sz_z);
-  Int3D global = Int3D{location[0] * Chunk::sz_x, location[1] * Chunk::sz_y, location[2] * Chunk::sz_z};
+  ChunkSnapshot snapshot{origin, region.get_chunk(location)};
+  constexpr int n = Chunk::sz_x;
+  for (int b = 0; b < n; ++b) {
+    for (int a = 0; a < n; ++a) {
+      int i = a + n * b;
+      snapshot.borders[nx][i] = adjacent_chunks[nx]->get_voxel(n - 1, a, b);
+      snapshot.borders[px][i] = adjacent_chunks[px]->get_voxel(0, a, b);
+      snapshot.borders[ny][i] = adjacent_chunks[ny]->get_voxel(a, n - 1, b);
+      snapshot.borders[py][i] = adjacent_chunks[py]->get_voxel(a, 0, b);
+      snapshot.borders[nz][i] = adjacent_chunks[nz]->get_voxel(a, b, n - 1);
+      snapshot.borders[pz][i] = adjacent_chunks[pz]->get_voxel(a, b, 0);
+    }
+  }
+  snapshot.enclosed = std::all_of(adjacent_chunks.begin(), adjacent_chunks.end(), [](const Chunk* adjacent_chunk) {
+    return adjacent_chunk->is_uniform() && vops::is_opaque(adjacent_chunk->get_uniform_voxel());
+  });
+  return snapshot;
+}
+
+void MeshGenerator::add_cube_face(MeshResult& result, std::vector<std::uint8_t>* greedy_faces, int x, int y, int z, int d, int texture, bool opaque) {
+  if (greedy_faces && opaque)
+    (*greedy_faces)[d * Chunk::sz + Chunk::get_index(x, y, z)] = texture + 1;
+  else
+    result.slab_meshes[y / Chunk::slab_sz_y].mesh.emplace_back(x, y, z, static_cast<Direction>(d), 1, 1, texture);
+}
+
+// Copies the chunk and the border slices around it into one padded buffer,
+// leaving out rows too far from the slabs to matter
+MeshGenerator::PaddedChunk MeshGenerator::pad_snapshot(const ChunkSnapshot& snapshot, std::uint32_t slabs) {
+  constexpr int n = Chunk::sz_x;
+  auto& chunk = snapshot.chunk;
+  auto& borders = snapshot.borders;
+  PaddedChunk padded;
+  for (int z = 0; z < n; ++z) {
+    for (int y = 0; y < n; ++y) {
+      if (!Chunk::in_slabs(slabs, y - 1) && !Chunk::in_slabs(slabs, y) && !Chunk::in_slabs(slabs, y + 1))
+        continue;
+      chunk.copy_voxels(Chunk::get_index(0, y, z), n, padded.data() + PaddedChunk::get_index(0, y, z));
+    }
+  }
+  for (int b = 0; b < n; ++b) {
+    for (int a = 0; a < n; ++a) {
+      int j = a + n * b;
+      padded.set_voxel(-1, a, b, borders[nx][j]);
+      padded.set_voxel(n, a, b, borders[px][j]);
+      padded.set_voxel(a, -1, b, borders[ny][j]);
+      padded.set_voxel(a, n, b, borders[py][j]);
+      padded.set_voxel(a, b, -1, borders[nz][j]);
+      padded.set_voxel(a, b, n, borders[pz][j]);
+    }
+  }
+  return padded;
+}
+
+// Reference mesher, looks at the six neighbours of every voxel
+void MeshGenerator::mesh_voxels(const PaddedChunk& padded, glm::vec3 chunk_position, MeshResult& result, std::vector<std::uint8_t>* greedy_faces) {
   for (int z = 0; z < Chunk::sz_z; ++z) {
     for (int y = 0; y < Chunk::sz_y; ++y) {
-      for (int x = 0; x < Chunk::sz_x; ++x) {
-        auto voxel = chunk.get_voxel(x, y, z);
+      if (!Chunk::in_slabs(result.slabs, y))
+        continue;
+      int i = PaddedChunk::get_index(0, y, z);
+      for (int x = 0; x < Chunk::sz_x; ++x, ++i) {
+        auto voxel = padded.get_voxel(i);
         if (voxel == Voxel::empty)
           continue;
 
         auto position = chunk_position + glm::vec3(x, y, z);
-        auto adjacent = get_adjacent_voxels(chunk, adjacent_chunks, x, y, z);
+        auto adjacent = padded.get_adjacent_voxels(i);
 
         if (vops::is_water(voxel)) {
-          mesh_water(water_mesh, position, voxel, adjacent);
+          mesh_water(result.slab_meshes[y / Chunk::slab_sz_y].water_mesh, position, voxel, adjacent);
           continue;
         }
 
         if (!vops::is_cube(voxel)) {
-          mesh_noncube(irregular_mesh, position, voxel);
+          mesh_noncube(result.slab_meshes[y / Chunk::slab_sz_y].irregular_mesh, position, voxel);
           continue;
         }
 
@@ -194,95 +287,252 @@ void MeshGenerator::mesh_chunk(const Region& region, const Location& location) {
 
         auto& textures = reinterpret_cast<std::array<int, 6>&>(voxel_textures);
 
-        if (adjacent[nx] < occluding_voxel_type) {
-          mesh.emplace_back(x, y, z, nx, br, textures[nx]);
-          mesh.emplace_back(x, y + 1, z + 1, nx, tl, textures[nx]);
-          mesh.emplace_back(x, y + 1, z, nx, tr, textures[nx]);
-          mesh.emplace_back(x, y, z, nx, br, textures[nx]);
-          mesh.emplace_back(x, y, z + 1, nx, bl, textures[nx]);
-          mesh.emplace_back(x, y + 1, z + 1, nx, tl, textures[nx]);
-        }
-        if (adjacent[px] < occluding_voxel_type) {
-          mesh.emplace_back(x + 1, y, z, px, bl, textures[px]);
-          mesh.emplace_back(x + 1, y + 1, z, px, tl, textures[px]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, px, tr, textures[px]);
-          mesh.emplace_back(x + 1, y, z, px, bl, textures[px]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, px, tr, textures[px]);
-          mesh.emplace_back(x + 1, y, z + 1, px, br, textures[px]);
-        }
-        if (adjacent[ny] < occluding_voxel_type) {
-          mesh.emplace_back(x, y, z, ny, bl, textures[ny]);
-          mesh.emplace_back(x + 1, y, z + 1, ny, tr, textures[ny]);
-          mesh.emplace_back(x, y, z + 1, ny, tl, textures[ny]);
-          
-          mesh.emplace_back(x, y, z, ny, bl, textures[ny]);
-          mesh.emplace_back(x + 1, y, z, ny, br, textures[ny]);
-          mesh.emplace_back(x + 1, y, z + 1, ny, tr, textures[ny]);
+        for (int d = 0; d < 6; ++d) {
+          if (adjacent[d] >= occluding_voxel_type)
+            continue;
+          add_cube_face(result, greedy_faces, x, y, z, d, textures[d], vops::is_opaque(voxel));
         }
-        if (adjacent[py] < occluding_voxel_type) {
-          mesh.emplace_back(x, y + 1, z, py, br, textures[py]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, py, tl, textures[py]);
-          mesh.emplace_back(x + 1, y + 1, z, py, tr, textures[py]);
-          mesh.emplace_back(x, y + 1, z, py, br, textures[py]);
-          mesh.emplace_back(x, y + 1, z + 1, py, bl, textures[py]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, py, tl, textures[py]);
-        }
-        if (adjacent[nz] < occluding_voxel_type) {
-          mesh.emplace_back(x, y, z, nz, bl, textures[nz]);
-          mesh.emplace_back(x, y + 1, z, nz, tl, textures[nz]);
-          mesh.emplace_back(x + 1, y + 1, z, nz, tr, textures[nz]);
-          mesh.emplace_back(x, y, z, nz, bl, textures[nz]);
-          mesh.emplace_back(x + 1, y + 1, z, nz, tr, textures[nz]);
-          mesh.emplace_back(x + 1, y, z, nz, br, textures[nz]);
+      }
+    }
+  }
+}
+
+// Keeps a bitmask per row of voxels along x and finds the visible faces of a
+// whole row with a few shifts and ANDs. Only voxels with a visible face, water
+// or irregular voxels are looked at individually.
+void MeshGenerator::mesh_rows(const PaddedChunk& padded, glm::vec3 chunk_position, MeshResult& result, std::vector<std::uint8_t>* greedy_faces) {
+  constexpr int n = Chunk::sz_x;
+  static_assert(n == 32, "rows have to fit in a 32 bit mask");
+
+  constexpr int num_voxels = static_cast<int>(Voxel::voxel_enum_size);
+  std::array<bool, num_voxels> opaque_voxels, cube_voxels;
+  for (int v = 0; v < num_voxels; ++v) {
+    opaque_voxels[v] = vops::is_opaque(static_cast<Voxel>(v));
+    cube_voxels[v] = vops::is_cube(static_cast<Voxel>(v));
+  }
+
+  // rows indexed [z + 1][y + 1], including the border rows around the chunk
+  using Rows = std::array<std::array<std::uint32_t, n + 2>, n + 2>;
+  Rows opaque, cubes, others;
+  // opacity of the voxels just past either end of each row, 0 or 1
+  Rows opaque_nx, opaque_px;
+  auto slabs = result.slabs;
+  for (int z = -1; z <= n; ++z) {
+    for (int y = -1; y <= n; ++y) {
+      // only rows in or next to the slabs being meshed are looked at
+      if (!Chunk::in_slabs(slabs, y - 1) && !Chunk::in_slabs(slabs, y) && !Chunk::in_slabs(slabs, y + 1))
+        continue;
+      int i = PaddedChunk::get_index(0, y, z);
+      std::uint32_t o = 0, c = 0, other = 0;
+      for (int x = 0; x < n; ++x) {
+        auto voxel = padded.get_voxel(i + x);
+        int v = static_cast<int>(voxel);
+        std::uint32_t bit = 1u << x;
+        o |= opaque_voxels[v] ? bit : 0;
+        c |= cube_voxels[v] ? bit : 0;
+        other |= (voxel != Voxel::empty && !cube_voxels[v]) ? bit : 0;
+      }
+      opaque[z + 1][y + 1] = o;
+      cubes[z + 1][y + 1] = c;
+      others[z + 1][y + 1] = other;
+      opaque_nx[z + 1][y + 1] = opaque_voxels[static_cast<int>(padded.get_voxel(i - 1))];
+      opaque_px[z + 1][y + 1] = opaque_voxels[static_cast<int>(padded.get_voxel(i + n))];
+    }
+  }
+
+  for (int z = 0; z < n; ++z) {
+    for (int y = 0; y < n; ++y) {
+      if (!Chunk::in_slabs(result.slabs, y))
+        continue;
+      auto o = opaque[z + 1][y + 1];
+      // non-opaque cubes show every face
+      auto always = cubes[z + 1][y + 1] & ~o;
+      std::array<std::uint32_t, 6> visible;
+      visible[nx] = (o & ~((o << 1) | opaque_nx[z + 1][y + 1])) | always;
+      visible[px] = (o & ~((o >> 1) | (opaque_px[z + 1][y + 1] << (n - 1)))) | always;
+      visible[ny] = (o & ~opaque[z + 1][y]) | always;
+      visible[py] = (o & ~opaque[z + 1][y + 2]) | always;
+      visible[nz] = (o & ~opaque[z][y + 1]) | always;
+      visible[pz] = (o & ~opaque[z + 2][y + 1]) | always;
+
+      int row_index = PaddedChunk::get_index(0, y, z);
+      auto row = visible[nx] | visible[px] | visible[ny] | visible[py] | visible[nz] | visible[pz];
+      while (row) {
+        int x = std::countr_zero(row);
+        row &= row - 1;
+        int i = row_index + x;
+        auto voxel = padded.get_voxel(i);
+        // only the voxel above decides the textures
+        std::array<Voxel, 6> adjacent{};
+        adjacent[py] = padded.get_voxel(i + PaddedChunk::stride_y);
+        auto voxel_textures = MeshUtils::get_textures(voxel, adjacent);
+        auto& textures = reinterpret_cast<std::array<int, 6>&>(voxel_textures);
+        bool voxel_opaque = (o >> x) & 1;
+        for (int d = 0; d < 6; ++d) {
+          if ((visible[d] >> x) & 1)
+            add_cube_face(result, greedy_faces, x, y, z, d, textures[d], voxel_opaque);
         }
-        if (adjacent[pz] < occluding_voxel_type) {
-          mesh.emplace_back(x, y, z + 1, pz, br, textures[pz]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, pz, tl, textures[pz]);
-          mesh.emplace_back(x, y + 1, z + 1, pz, tr, textures[pz]);
-          mesh.emplace_back(x, y, z + 1, pz, br, textures[pz]);
-          mesh.emplace_back(x + 1, y, z + 1, pz, bl, textures[pz]);
-          mesh.emplace_back(x + 1, y + 1, z + 1, pz, tl, textures[pz]);
+      }
+
+      row = others[z + 1][y + 1];
+      while (row) {
+        int x = std::countr_zero(row);
+        row &= row - 1;
+        int i = row_index + x;
+        auto voxel = padded.get_voxel(i);
+        auto position = chunk_position + glm::vec3(x, y, z);
+        if (vops::is_water(voxel)) {
+          auto adjacent = padded.get_adjacent_voxels(i);
+          mesh_water(result.slab_meshes[y / Chunk::slab_sz_y].water_mesh, position, voxel, adjacent);
+        } else {
+          mesh_noncube(result.slab_meshes[y / Chunk::slab_sz_y].irregular_mesh, position, voxel);
         }
       }
     }
   }
 }
 
+MeshGenerator::MeshResult MeshGenerator::mesh_chunk(const ChunkSnapshot& snapshot, std::uint32_t slabs) {
+  auto& chunk = snapshot.chunk;
+  MeshResult result{chunk.get_location(), 0, slabs};
+
+  // uniform chunks are either air or solid throughout, only the faces towards
+  // non-opaque neighbours can be visible
+  if (chunk.is_uniform()) {
+    auto voxel = chunk.get_uniform_voxel();
+    if (voxel == Voxel::empty)
+      return result;
+    if (vops::is_opaque(voxel) && snapshot.enclosed)
+      return result;
+  }
+
+  auto* pool = MeshBufferPool::instance();
+  for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+    if (!((slabs >> slab) & 1))
+      continue;
+    auto& slab_mesh = result.slab_meshes[slab];
+    slab_mesh.mesh = pool->acquire_faces(defacto_faces_per_mesh / Chunk::num_slabs);
+    slab_mesh.irregular_mesh = pool->acquire_vertices();
+    slab_mesh.water_mesh = pool->acquire_vertices();
+  }
+  // texture + 1 of every opaque face left for merge_faces, by direction then
+  // voxel index, 0 where there's no face
+  std::vector<std::uint8_t> greedy_faces;
+  bool greedy = greedy_meshing;
+  if (greedy)
+    greedy_faces.resize(6 * Chunk::sz);
+  auto& location = chunk.get_location();
+  auto& origin = snapshot.origin;
+  glm::vec3 chunk_position(
+    (location[0] - origin[0]) * Chunk::sz_x, (location[1] - origin[1]) * Chunk::sz_y, (location[2] - origin[2]) * Chunk::sz_z);
+  auto padded = pad_snapshot(snapshot, slabs);
+  if (bitmask_meshing)
+    mesh_rows(padded, chunk_position, result, greedy ? &greedy_faces : nullptr);
+  else
+    mesh_voxels(padded, chunk_position, result, greedy ? &greedy_faces : nullptr);
+  if (greedy)
+    merge_faces(result, greedy_faces);
+  return result;
+}
+
+void MeshGenerator::dispatch(Region& region, const Region::Diff& diff) {
+  auto& loc = diff.location;
+  auto generation = next_generation_++;
+  for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+    if ((diff.slabs >> slab) & 1)
+      generations_[SlabLocation{loc, slab}] = generation;
+  }
+  auto snapshot = std::make_shared<const ChunkSnapshot>(take_snapshot(region, loc, origin_));
+  JobSystem::instance()->submit([this, snapshot, generation, slabs = diff.slabs, edited = diff.edited](int worker) {
+    auto result = mesh_chunk(*snapshot, slabs);
+    result.generation = generation;
+    result.edited = edited;
+    completed_.push(worker, std::move(result));
+  });
+}
+
 void MeshGenerator::consume_region(Region& region) {
   auto& diffs = region.get_diffs();
-  /*   int num_meshed = 0;
-    float total_duration = 0.0; */
+
+  // creations for the same chunk are merged into one job
+  std::vector<Region::Diff> creations;
+  std::unordered_map<Location, std::size_t, LocationHash> creation_idx;
+
+  // lods are placed relative to the origin too, and can be uploaded before
+  // any chunk is meshed
+  if (!origin_set_) {
+    origin_ = Chunk::pos_to_loc(region.get_player().get_position());
+    origin_set_ = true;
+    diffs_.emplace_back(origin_, Diff::origin);
+  }
 
   for (auto& diff : diffs) {
     auto& loc = diff.location;
 
-    if (!origin_set_) {
-      origin_ = loc;
-      origin_set_ = true;
-      diffs_.emplace_back(origin_, Diff::origin);
-    }
-
     if (diff.kind == Region::Diff::creation) {
-      auto& chunk = region.get_chunk(loc);
-      //      auto start = std::chrono::high_resolution_clock::now();
-      random_seed_ = 0;
-      mesh_chunk(region, loc);
-      diffs_.emplace_back(loc, Diff::creation);
-
-      /*             auto end = std::chrono::high_resolution_clock::now();
-
-                  auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end - start);
-                  std::cout << "mesh time: " << duration.count() << std::endl */
-
-      /*     num_meshed++;
-          total_duration += duration.count(); */
+      auto it = creation_idx.find(loc);
+      if (it == creation_idx.end()) {
+        creation_idx.insert({loc, creations.size()});
+        creations.push_back(diff);
+      } else {
+        auto& creation = creations[it->second];
+        creation.slabs |= diff.slabs;
+        // latency is counted from the earliest edit
+        std::chrono::steady_clock::time_point none{};
+        if (diff.edited != none && (creation.edited == none || diff.edited < creation.edited))
+          creation.edited = diff.edited;
+      }
     } else if (diff.kind == Region::Diff::deletion) {
+      auto it = creation_idx.find(loc);
+      if (it != creation_idx.end()) {
+        creations[it->second].slabs = 0;
+        creation_idx.erase(it);
+      }
+      for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+        SlabLocation slab_loc{loc, slab};
+        generations_.erase(slab_loc);
+        auto count = cube_face_counts_.find(slab_loc);
+        if (count != cube_face_counts_.end()) {
+          cube_face_count_ -= count->second;
+          cube_face_counts_.erase(count);
+        }
+      }
       diffs_.emplace_back(loc, Diff::deletion);
     }
   }
-  /* if (num_meshed > 0)
-    std::cout << "Average execution time: " << total_duration / num_meshed << " microseconds" << std::endl; */
+  for (auto& creation : creations) {
+    if (creation.slabs != 0)
+      dispatch(region, creation);
+  }
   region.clear_diffs();
+  collect_meshes();
+}
+
+// Picks up meshes finished by the workers since the last call
+void MeshGenerator::collect_meshes() {
+  MeshResult result;
+  while (completed_.try_pop(result)) {
+    for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+      if (!((result.slabs >> slab) & 1))
+        continue;
+      SlabLocation loc{result.location, slab};
+      auto& slab_mesh = result.slab_meshes[slab];
+      auto it = generations_.find(loc);
+      if (it == generations_.end() || it->second != result.generation) {
+        recycle(std::move(slab_mesh));
+        continue;
+      }
+      generations_.erase(it);
+      auto& face_count = cube_face_counts_[loc];
+      cube_face_count_ += slab_mesh.mesh.size() - face_count;
+      face_count = slab_mesh.mesh.size();
+      auto [mesh, inserted] = meshes_.try_emplace(loc);
+      if (!inserted)
+        recycle(std::move(mesh->second));
+      mesh->second = std::move(slab_mesh);
+      diffs_.emplace_back(result.location, Diff::creation, slab, result.edited);
+    }
+  }
 }
 
 const std::vector<MeshGenerator::Diff>& MeshGenerator::get_diffs() const {
@@ -290,27 +540,31 @@ const std::vector<MeshGenerator::Diff>& MeshGenerator::get_diffs() const {
 }
 
 void MeshGenerator::clear_diffs() {
+  // meshes nobody took
+  for (auto& [loc, slab_mesh] : meshes_)
+    recycle(std::move(slab_mesh));
   meshes_.clear();
-  irregular_meshes_.clear();
-  water_meshes_.clear();
   diffs_.clear();
 }
 
-const std::unordered_map<Location, std::vector<CubeVertex>, LocationHash>& MeshGenerator::get_meshes() const {
-  return meshes_;
+std::size_t MeshGenerator::get_cube_face_count() const {
+  return cube_face_count_;
 }
 
 const Location& MeshGenerator::get_origin() const {
   return origin_;
 }
 
-const std::vector<CubeVertex> MeshGenerator::get_mesh(const Location& loc) const {
-  return meshes_.at(loc);
-}
-const std::vector<Vertex> MeshGenerator::get_irregular_mesh(const Location& loc) const {
-  return irregular_meshes_.at(loc);
+MeshGenerator::SlabMesh MeshGenerator::take_mesh(const SlabLocation& loc) {
+  auto node = meshes_.extract(loc);
+  if (node.empty())
+    return SlabMesh{};
+  return std::move(node.mapped());
 }
 
-const std::vector<Vertex> MeshGenerator::get_water_mesh(const Location& loc) const {
-  return water_meshes_.at(loc);
-}
\ No newline at end of file
+void MeshGenerator::recycle(SlabMesh&& slab_mesh) {
+  auto* pool = MeshBufferPool::instance();
+  pool->release(std::move(slab_mesh.mesh));
+  pool->release(std::move(slab_mesh.irregular_mesh));
+  pool->release(std::move(slab_mesh.water_mesh));
+}
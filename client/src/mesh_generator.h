@@ -1,8 +1,12 @@
 #ifndef MESH_GENERATOR_H
 #define MESH_GENERATOR_H
 
+#include <atomic>
+#include <chrono>
 #include <unordered_map>
 #include <vector>
+#include "job_system.h"
+#include "padded_voxels.h"
 #include "region.h"
 #include "types.h"
 #include "voxel.h"
@@ -17,35 +21,83 @@ public:
     };
     Location location;
     Kind kind;
+    // slab of the chunk a creation is for, deletions are for every slab
+    int slab = 0;
+    // when the voxel edit that caused a creation was made, if there was one
+    std::chrono::steady_clock::time_point edited{};
+  };
+
+  // Everything needed to mesh a chunk, copied so a worker can mesh it while
+  // the region keeps changing
+  struct ChunkSnapshot {
+    Location origin;
+    Chunk chunk;
+    // the neighbouring chunks' slices touching this chunk, indexed by Direction
+    std::array<std::array<Voxel, Chunk::sz_x * Chunk::sz_y>, 6> borders;
+    // every neighbour is uniformly opaque
+    bool enclosed;
+  };
+  struct SlabMesh {
+    std::vector<CubeFace> mesh;
+    std::vector<Vertex> irregular_mesh;
+    std::vector<Vertex> water_mesh;
+  };
+  struct MeshResult {
+    Location location;
+    std::uint64_t generation;
+    // slabs that were meshed, the others are left empty
+    std::uint32_t slabs;
+    std::chrono::steady_clock::time_point edited;
+    std::array<SlabMesh, Chunk::num_slabs> slab_meshes;
   };
 
   MeshGenerator();
   void consume_region(Region& region);
-  const std::unordered_map<Location, std::vector<CubeVertex>, LocationHash>& get_meshes() const;
-  const std::vector<CubeVertex> get_mesh(const Location& loc) const;
-  const std::vector<Vertex> get_irregular_mesh(const Location& loc) const;
-  const std::vector<Vertex> get_water_mesh(const Location& loc) const;
+  // Hands over the mesh of a slab created since the last clear_diffs
+  SlabMesh take_mesh(const SlabLocation& loc);
+  // Returns the vectors of a mesh that's no longer needed to MeshBufferPool
+  static void recycle(SlabMesh&& slab_mesh);
   const std::vector<Diff>& get_diffs() const;
   const Location& get_origin() const;
+  // faces across the cube meshes collected so far and not deleted
+  std::size_t get_cube_face_count() const;
   void clear_diffs();
-  static constexpr int defacto_vertices_per_mesh = 80000;
+  static constexpr int defacto_faces_per_mesh = 14000;
   static constexpr int defacto_vertices_per_irregular_mesh = 4000;
   static constexpr int defacto_vertices_per_water_mesh = 3000;
 
+  static ChunkSnapshot take_snapshot(const Region& region, const Location& location, const Location& origin);
+  static MeshResult mesh_chunk(const ChunkSnapshot& snapshot, std::uint32_t slabs = Chunk::all_slabs);
+
+  // merge coplanar opaque faces with the same texture into larger quads
+  static std::atomic<bool> greedy_meshing;
+  // cull faces a row of voxels at a time with bitmasks instead of voxel by voxel
+  static std::atomic<bool> bitmask_meshing;
+
 private:
-  void mesh_chunk(const Region& region, const Location& location);
-  void mesh_noncube(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel);
-  void mesh_water(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel, std::array<Voxel, 6>& adjacent);
-  std::array<Voxel, 6> get_adjacent_voxels(const Chunk& chunk, std::array<const Chunk*, 6>& adjacent_chunks, int x, int y, int z) const;
-
-  std::unordered_map<Location, std::vector<CubeVertex>, LocationHash> meshes_;
-  std::unordered_map<Location, std::vector<Vertex>, LocationHash> irregular_meshes_;
-  std::unordered_map<Location, std::vector<Vertex>, LocationHash> water_meshes_;
+  using PaddedChunk = PaddedVoxels<Chunk::sz_x, Chunk::sz_y, Chunk::sz_z>;
+
+  void collect_meshes();
+  static PaddedChunk pad_snapshot(const ChunkSnapshot& snapshot, std::uint32_t slabs);
+  static void mesh_voxels(const PaddedChunk& padded, glm::vec3 chunk_position, MeshResult& result, std::vector<std::uint8_t>* greedy_faces);
+  static void mesh_rows(const PaddedChunk& padded, glm::vec3 chunk_position, MeshResult& result, std::vector<std::uint8_t>* greedy_faces);
+  static void add_cube_face(MeshResult& result, std::vector<std::uint8_t>* greedy_faces, int x, int y, int z, int d, int texture, bool opaque);
+  static void merge_faces(MeshResult& result, std::vector<std::uint8_t>& faces);
+  void dispatch(Region& region, const Region::Diff& diff);
+  static void mesh_noncube(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel);
+  static void mesh_water(std::vector<Vertex>& mesh, glm::vec3& position, Voxel voxel, std::array<Voxel, 6>& adjacent);
+
+  std::unordered_map<SlabLocation, SlabMesh, SlabLocationHash> meshes_;
   std::vector<Diff> diffs_;
+  // latest meshing job dispatched for each slab, older results are dropped
+  std::unordered_map<SlabLocation, std::uint64_t, SlabLocationHash> generations_;
+  std::uint64_t next_generation_ = 0;
+  std::unordered_map<SlabLocation, std::size_t, SlabLocationHash> cube_face_counts_;
+  std::size_t cube_face_count_ = 0;
+  CompletionQueue<MeshResult> completed_;
 
   Location origin_;
   bool origin_set_ = false;
-  std::uint32_t random_seed_ = 0;
 };
 
 #endif
\ No newline at end of file
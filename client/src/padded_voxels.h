@@ -0,0 +1,63 @@
+#ifndef PADDED_VOXELS_H
+#define PADDED_VOXELS_H
+
+#include <array>
+#include <vector>
+#include "types.h"
+#include "voxel.h"
+
+/*
+  A block of voxels together with a one voxel border taken from its
+  neighbours, in one contiguous buffer. Coordinates run from -1 to the extent
+  inclusive, so the six neighbours of any interior voxel are at constant
+  offsets from it and meshers can look them up without bounds checks or
+  reaching into other chunks. The twelve edges and eight corners of the border
+  are never filled.
+*/
+template <int SizeX, int SizeY, int SizeZ>
+class PaddedVoxels {
+public:
+  static constexpr int stride_y = SizeX + 2;
+  static constexpr int stride_z = stride_y * (SizeY + 2);
+  static constexpr int sz = stride_z * (SizeZ + 2);
+  // index offsets of the neighbours, by Direction
+  static constexpr std::array<int, 6> offsets = {-1, 1, -stride_y, stride_y, -stride_z, stride_z};
+
+  PaddedVoxels() : voxels_(sz, Voxel::empty) {}
+
+  static int get_index(int x, int y, int z) {
+    return (x + 1) + stride_y * (y + 1) + stride_z * (z + 1);
+  }
+
+  Voxel get_voxel(int i) const {
+    return voxels_[i];
+  }
+
+  Voxel get_voxel(int x, int y, int z) const {
+    return voxels_[get_index(x, y, z)];
+  }
+
+  void set_voxel(int i, Voxel voxel) {
+    voxels_[i] = voxel;
+  }
+
+  void set_voxel(int x, int y, int z, Voxel voxel) {
+    voxels_[get_index(x, y, z)] = voxel;
+  }
+
+  Voxel* data() {
+    return voxels_.data();
+  }
+
+  std::array<Voxel, 6> get_adjacent_voxels(int i) const {
+    std::array<Voxel, 6> adjacent;
+    for (int d = 0; d < 6; ++d)
+      adjacent[d] = voxels_[i + offsets[d]];
+    return adjacent;
+  }
+
+private:
+  std::vector<Voxel> voxels_;
+};
+
+#endif
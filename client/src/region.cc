@@ -1,15 +1,18 @@
 #include "region.h"
+#include <algorithm>
 #include <array>
 #include <cfloat>
 #include <chrono>
+#include <cstdlib>
 #include <iostream>
 #include <optional>
 #include <queue>
+#include "cs_math.h"
 
 int Region::max_sz = 512;
 int Region::max_sz_internal = Region::max_sz * 2;
 
-std::unordered_map<Location, Chunk, LocationHash>& Region::get_chunks() {
+ChunkGrid& Region::get_chunks() {
   return chunks_;
 }
 
@@ -44,39 +47,59 @@ std::array<Location, 6> Region::get_adjacent_locations(const Location& loc) cons
     Location{loc[0], loc[1], loc[2] + 1}};
 }
 
-void Region::delete_furthest_chunk(const Location& loc) {
-  if (chunks_sent_.size() >= max_sz) {
-    int max_difference = 0;
-    Chunk* chunk_to_delete = nullptr;
-    const Location* to_delete;
-    for (auto& location : chunks_sent_) {
-      auto& chunk = chunks_.at(location);
-      if (chunk.check_flag(ChunkFlags::Deleted)) {
-        continue;
-      }
+Location Region::get_player_location() const {
+  return Chunk::pos_to_loc(player_.get_position());
+}
 
-      int difference = LocationMath::distance(loc, location);
-      if (difference > max_difference) {
-        max_difference = difference;
-        chunk_to_delete = &chunk;
-        to_delete = &location;
-      }
-    }
-    chunk_to_delete->set_flag(ChunkFlags::Deleted);
-    diffs_.emplace_back(*to_delete, Diff::deletion);
-    chunks_sent_.erase(*to_delete);
+void Region::delete_furthest_chunk() {
+  if (chunks_sent_.size() >= max_sz) {
+    chunks_sent_.set_center(get_player_location());
+    auto location = chunks_sent_.pop_farthest();
+    chunks_.at(location).set_flag(ChunkFlags::Deleted);
+    diffs_.emplace_back(location, Diff::deletion);
   }
 }
 
+void Region::mark_sent(const Location& loc) {
+  delete_furthest_chunk();
+  chunks_unsent_.erase(loc);
+  chunks_sent_.insert(loc);
+}
+
 void Region::chunk_to_mesh_generator(const Location& loc) {
-  delete_furthest_chunk(loc);
+  mark_sent(loc);
   diffs_.emplace_back(loc, Diff::creation);
-  chunks_sent_.insert(loc);
+}
+
+// Frees the grid slot of a chunk the loaded window has scrolled past
+void Region::evict_chunk(Location loc) {
+  auto adjacent = get_adjacent_locations(loc);
+  // meshing these needs the chunk that's about to go away
+  std::erase_if(diffs_, [&loc, &adjacent](const Diff& diff) {
+    return diff.kind == Diff::creation &&
+           (diff.location == loc || std::find(adjacent.begin(), adjacent.end(), diff.location) != adjacent.end());
+  });
+  if (chunks_sent_.contains(loc)) {
+    diffs_.emplace_back(loc, Diff::deletion);
+    chunks_sent_.erase(loc);
+  }
+  chunks_unsent_.erase(loc);
+  chunks_.erase(loc);
+  for (auto& location : adjacent) {
+    ++adjacents_missing_[location];
+  }
 }
 
 void Region::add_chunk(Chunk&& chunk) {
   auto loc = chunk.get_location();
-  chunks_.insert({loc, std::move(chunk)});
+  chunk.compact();
+  if (chunk.is_uniform() && chunk.get_uniform_voxel() == Voxel::empty)
+    chunk.set_flag(ChunkFlags::Empty);
+  auto* occupant = chunks_.get_occupant(loc);
+  if (occupant != nullptr)
+    evict_chunk(occupant->get_location());
+  chunks_.insert(std::move(chunk));
+  chunks_unsent_.insert(loc);
 
   auto adjacent = get_adjacent_locations(loc);
 
@@ -89,6 +112,7 @@ void Region::add_chunk(Chunk&& chunk) {
     if (adjacents_missing_[location] == 0 &&
         chunks_.contains(location) &&
         !chunks_sent_.contains(location) &&
+        in_mesh_range(location) &&
         !chunks_.at(location).check_flag(ChunkFlags::Deleted) &&
         !chunks_.at(location).check_flag(ChunkFlags::Empty)) {
       chunk_to_mesh_generator(location);
@@ -99,11 +123,45 @@ void Region::add_chunk(Chunk&& chunk) {
     adjacents_missing_.insert({loc, 6});
   } else if (
     adjacents_missing_[loc] == 0 &&
+    in_mesh_range(loc) &&
     !chunks_.at(loc).check_flag(ChunkFlags::Empty)) {
     chunk_to_mesh_generator(loc);
   }
 }
 
+bool Region::in_mesh_range(const Location& loc) const {
+  auto center = get_player_location();
+  return std::max(std::abs(loc[0] - center[0]), std::abs(loc[2] - center[2])) <= mesh_distance;
+}
+
+// Drops the meshes of chunks the player has moved away from, past
+// mesh_distance where lods are drawn instead, and meshes the ones it came
+// back to. The chunks themselves are kept.
+void Region::update_meshes() {
+  std::vector<Location> to_drop;
+  std::vector<Location> to_mesh;
+  chunks_.for_each([&](const Chunk& chunk) {
+    auto& loc = chunk.get_location();
+    if (chunk.check_flag(ChunkFlags::Deleted))
+      return;
+    bool in_range = in_mesh_range(loc);
+    if (chunks_sent_.contains(loc)) {
+      if (!in_range)
+        to_drop.push_back(loc);
+    } else if (in_range && adjacents_missing_[loc] == 0 && !chunk.check_flag(ChunkFlags::Empty)) {
+      to_mesh.push_back(loc);
+    }
+  });
+  for (auto& loc : to_drop) {
+    // without the Deleted flag clear_diffs keeps the chunk
+    chunks_sent_.erase(loc);
+    chunks_unsent_.insert(loc);
+    diffs_.emplace_back(loc, Diff::deletion);
+  }
+  for (auto& loc : to_mesh)
+    chunk_to_mesh_generator(loc);
+}
+
 const std::vector<Region::Diff>& Region::get_diffs() const {
   return diffs_;
 }
@@ -112,6 +170,10 @@ void Region::clear_diffs() {
   for (auto& diff : diffs_) {
     auto& loc = diff.location;
     if (diff.kind == Region::Diff::deletion) {
+      // evicted chunks have already been removed
+      auto* chunk = chunks_.find(loc);
+      if (chunk == nullptr || !chunk->check_flag(ChunkFlags::Deleted))
+        continue;
       chunks_.erase(loc);
       // std::cout<<"deleting at "<<loc<<std::endl;
       auto adjacent = get_adjacent_locations(loc);
@@ -122,28 +184,14 @@ void Region::clear_diffs() {
   }
 
   if (chunks_.size() > max_sz_internal) {
-    std::vector<Location> loaded_locations;
-    for (auto& [location, _] : chunks_) {
-      if (!chunks_sent_.contains(location))
-        loaded_locations.push_back(location);
-    }
-
-    auto& player_location_ = player_.get_last_location();
-    std::sort(
-      loaded_locations.begin(), loaded_locations.end(),
-      [&player_location_](const Location l1, const Location l2) {
-        auto d1 = LocationMath::distance(l1, player_location_);
-        auto d2 = LocationMath::distance(l2, player_location_);
-        return d1 > d2;
-      });
+    chunks_unsent_.set_center(get_player_location());
     int to_remove = chunks_.size() - max_sz_internal;
-
-    for (int i = 0; i < to_remove; ++i) {
-      auto& location = loaded_locations[i];
+    for (int i = 0; i < to_remove && !chunks_unsent_.empty(); ++i) {
+      auto location = chunks_unsent_.pop_farthest();
       chunks_.erase(location);
       // std::cout<<"removing at "<<location<<std::endl;
 
-      auto adjacent = get_adjacent_locations(loaded_locations[i]);
+      auto adjacent = get_adjacent_locations(location);
       for (auto& location : adjacent) {
         ++adjacents_missing_[location];
       }
@@ -158,9 +206,9 @@ Location Region::location_from_global_coord(int x, int y, int z) {
 }
 Location Region::location_from_global_coord(const Int3D& coord) {
   return Location{
-    static_cast<int>(std::floor(static_cast<double>(coord[0]) / Chunk::sz_x)),
-    static_cast<int>(std::floor(static_cast<double>(coord[1]) / Chunk::sz_y)),
-    static_cast<int>(std::floor(static_cast<double>(coord[2]) / Chunk::sz_z)),
+    cs_math::floor_div(coord[0], Chunk::sz_x),
+    cs_math::floor_div(coord[1], Chunk::sz_y),
+    cs_math::floor_div(coord[2], Chunk::sz_z),
   };
 }
 
@@ -191,6 +239,18 @@ void Region::set_voxel(const Int3D& coord, Voxel voxel) {
     voxel);
 }
 
+std::size_t Region::get_voxel_memory_usage() const {
+  std::size_t usage = 0;
+  chunks_.for_each([&usage](const Chunk& chunk) {
+    usage += chunk.get_memory_usage();
+  });
+  return usage;
+}
+
+std::size_t Region::get_undo_memory_usage() const {
+  return undo_journal_.get_memory_usage();
+}
+
 Player& Region::get_player() {
   return player_;
 }
@@ -253,28 +313,32 @@ std::vector<Int3D> Region::raycast(const glm::dvec3& pos, const glm::dvec3& dir,
   return visited_voxels;
 }
 
-void Region::update_adjacent_chunks(const Int3D& coord) {
-  std::unordered_set<Location, LocationHash> dirty;
+// Remeshes the slabs of the chunk holding coord and of any neighbouring chunk
+// the voxel at coord touches
+void Region::remesh_around(const Int3D& coord, std::chrono::steady_clock::time_point edited) {
+  std::unordered_map<Location, std::uint32_t, LocationHash> dirty;
   auto loc = location_from_global_coord(coord);
   auto local = Chunk::to_local(coord);
+  auto slabs = Chunk::get_slabs_around(local[1]);
+  dirty[loc] = slabs;
   if (local[0] == 0) {
-    dirty.insert(Location{loc[0] - 1, loc[1], loc[2]});
+    dirty[Location{loc[0] - 1, loc[1], loc[2]}] = slabs;
   } else if (local[0] == Chunk::sz_x - 1) {
-    dirty.insert(Location{loc[0] + 1, loc[1], loc[2]});
+    dirty[Location{loc[0] + 1, loc[1], loc[2]}] = slabs;
   }
   if (local[1] == 0) {
-    dirty.insert(Location{loc[0], loc[1] - 1, loc[2]});
+    dirty[Location{loc[0], loc[1] - 1, loc[2]}] = 1u << (Chunk::num_slabs - 1);
   } else if (local[1] == Chunk::sz_y - 1) {
-    dirty.insert(Location{loc[0], loc[1] + 1, loc[2]});
+    dirty[Location{loc[0], loc[1] + 1, loc[2]}] = 1u;
   }
   if (local[2] == 0) {
-    dirty.insert(Location{loc[0], loc[1], loc[2] - 1});
+    dirty[Location{loc[0], loc[1], loc[2] - 1}] = slabs;
   } else if (local[2] == Chunk::sz_z - 1) {
-    dirty.insert(Location{loc[0], loc[1], loc[2] + 1});
+    dirty[Location{loc[0], loc[1], loc[2] + 1}] = slabs;
   }
-  for (auto& loc : dirty) {
+  for (auto& [loc, slabs] : dirty) {
     if (chunks_sent_.contains(loc) && adjacents_missing_[loc] == 0) {
-      diffs_.emplace_back(loc, Diff::creation);
+      diffs_.emplace_back(loc, Diff::creation, slabs, edited);
     }
   }
 }
@@ -339,13 +403,12 @@ void Region::raycast_place(const glm::dvec3& pos, const glm::dvec3& dir, Voxel v
           chunk.set_voxel(local[0], local[1], local[2], voxel);
           updated_since_reset_.insert(loc);
 
+          auto edited = std::chrono::steady_clock::now();
           if (!chunks_sent_.contains(loc)) {
-            delete_furthest_chunk(loc);
-            chunks_sent_.insert(loc);
+            mark_sent(loc);
+            diffs_.emplace_back(loc, Diff::creation, Chunk::all_slabs, edited);
           }
-          diffs_.emplace_back(loc, Diff::creation);
-
-          update_adjacent_chunks(coord);
+          remesh_around(coord, edited);
         }
 
         break;
@@ -366,8 +429,7 @@ void Region::raycast_remove(const Camera& camera) {
       if (voxel != Voxel::empty) {
         chunk.set_voxel(local[0], local[1], local[2], Voxel::empty);
         updated_since_reset_.insert(loc);
-        diffs_.emplace_back(loc, Diff::creation);
-        update_adjacent_chunks(coord);
+        remesh_around(coord, std::chrono::steady_clock::now());
         break;
       }
     }
@@ -392,61 +454,80 @@ void Region::signal_chunk_update(const Location& loc) {
   if (adjacents_missing_[loc] != 0)
     return;
   if (!chunks_sent_.contains(loc)) {
-    chunk_to_mesh_generator(loc);
+    if (in_mesh_range(loc))
+      chunk_to_mesh_generator(loc);
   } else {
     diffs_.emplace_back(loc, Diff::creation);
   }
   updated_since_reset_.insert(loc);
 }
 
-bool Region::set_voxel_if_possible(const Location& loc, int idx, Voxel voxel) {
-
-  auto it = chunks_.find(loc);
-  if (it == chunks_.end())
-    return false;
-  auto& chunk = it->second;
-
-  chunk.set_voxel(idx, voxel);
-  return true;
+// Sends every meshed chunk to the mesh generator again
+void Region::remesh_all() {
+  chunks_.for_each([this](const Chunk& chunk) {
+    auto& loc = chunk.get_location();
+    if (chunks_sent_.contains(loc) && adjacents_missing_[loc] == 0)
+      diffs_.emplace_back(loc, Diff::creation);
+  });
 }
 
 bool Region::set_voxel_with_history(const Int3D& coord, Voxel voxel) {
   auto loc = Region::location_from_global_coord(coord);
-  auto it = chunks_.find(loc);
-  if (it == chunks_.end())
+  auto* chunk_ptr = chunks_.find(loc);
+  if (chunk_ptr == nullptr)
     return false;
-  auto& chunk = it->second;
+  auto& chunk = *chunk_ptr;
   auto local_coord = Chunk::to_local(coord);
   int idx = Chunk::get_index(local_coord);
-  Voxel before = chunk.get_voxel(idx);
+  undo_journal_.record(loc, idx, chunk.get_voxel(idx));
   chunk.set_voxel(idx, voxel);
-  update_history_.emplace(coord, before);
-  ++update_sizes_.top();
   return true;
 }
 
 void Region::start_counting_swaps() {
-  update_sizes_.emplace(0);
+  undo_journal_.begin_update();
 }
 
+// Puts back every voxel of the last update a run at a time, then remeshes each
+// chunk it touched and the neighbours of any border it touched once
 void Region::undo_last_update() {
-  if (update_sizes_.size() == 0)
+  auto update = undo_journal_.pop_update();
+  if (!update.has_value())
     return;
   std::unordered_set<Location, LocationHash> dirty;
-  int size = update_sizes_.top();
-  for (int i = 0; i < size; ++i) {
-    auto& swap = update_history_.top();
-    auto loc = Region::location_from_global_coord(swap.coord);
-    auto local_coord = Chunk::to_local(swap.coord);
-    int idx = Chunk::get_index(local_coord);
-    bool success = set_voxel_if_possible(loc, idx, swap.voxel);
-    if (success)
-      tag_dirty_locs(dirty, loc, local_coord);
-    update_history_.pop();
+  for (auto& delta : *update) {
+    auto* chunk = chunks_.find(delta.location);
+    if (chunk == nullptr)
+      continue;
+    // by direction, whether a voxel on that face was changed
+    std::array<bool, 6> borders{};
+    UndoJournal::for_each_run(delta, [&](int i, int count, Voxel voxel) {
+      chunk->set_voxels(i, count, voxel);
+      int first_row = i / Chunk::sz_x;
+      int last_row = (i + count - 1) / Chunk::sz_x;
+      if (first_row != last_row) {
+        borders[0] = borders[1] = true;
+      } else {
+        borders[0] |= i % Chunk::sz_x == 0;
+        borders[1] |= (i + count - 1) % Chunk::sz_x == Chunk::sz_x - 1;
+      }
+      for (int row = first_row; row <= last_row; ++row) {
+        int y = row % Chunk::sz_y;
+        int z = row / Chunk::sz_y;
+        borders[2] |= y == 0;
+        borders[3] |= y == Chunk::sz_y - 1;
+        borders[4] |= z == 0;
+        borders[5] |= z == Chunk::sz_z - 1;
+      }
+    });
+    dirty.insert(delta.location);
+    auto adjacent = LocationMath::get_adjacent_locations(delta.location);
+    for (int d = 0; d < 6; ++d) {
+      if (borders[d])
+        dirty.insert(adjacent[d]);
+    }
   }
 
-  update_sizes_.pop();
-
   for (auto& loc : dirty)
     signal_chunk_update(loc);
 }
@@ -1,16 +1,19 @@
 #ifndef REGION_H
 #define REGION_H
 
+#include <chrono>
 #include <functional>
 #include <memory>
-#include <stack>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include "camera.h"
 #include "chunk.h"
+#include "chunk_grid.h"
+#include "eviction_index.h"
 #include "player.h"
 #include "section.h"
+#include "undo_journal.h"
 
 class Region {
 public:
@@ -21,13 +24,17 @@ public:
     };
     Location location;
     Kind kind;
+    // slabs of the chunk to remesh on creation
+    std::uint32_t slabs = Chunk::all_slabs;
+    // when the voxel edit behind the diff was made, if there was one
+    std::chrono::steady_clock::time_point edited{};
   };
 
   Player& get_player();
   const Chunk& get_chunk(const Location& loc) const;
    Chunk& get_chunk(const Location& loc);
   bool has_chunk(const Location& loc) const;
-  std::unordered_map<Location, Chunk, LocationHash>& get_chunks();
+  ChunkGrid& get_chunks();
   void add_chunk(Chunk&& chunk);
   const std::vector<Diff>& get_diffs() const;
   void clear_diffs();
@@ -42,11 +49,15 @@ public:
   static Location location_from_global_coord(const Int3D& coord);
   const std::unordered_set<Location, LocationHash> get_updated_since_reset() const;
   void reset_updated_since_reset();
+  std::size_t get_voxel_memory_usage() const;
+  std::size_t get_undo_memory_usage() const;
 
   bool set_voxel_with_history(const Int3D& coord, Voxel voxel);
   void start_counting_swaps();
   void undo_last_update();
   void signal_chunk_update(const Location& loc);
+  void remesh_all();
+  void update_meshes();
   static void tag_dirty_locs(std::unordered_set<Location, LocationHash>& dirty, const Location& loc, const Int3D& local_coord);
 
   static std::vector<Int3D> raycast(const glm::dvec3& pos, const glm::dvec3& dir, int num_voxels = 12);
@@ -58,27 +69,28 @@ public:
     const std::function<bool(Voxel v)>& kind_test) const;
 
   static int max_sz;
+  // chunks this close to the player, horizontally, are meshed
+  static constexpr int mesh_distance = 3;
 
 private:
-  struct CoordHistory {
-    Int3D coord;
-    Voxel voxel;
-  };
-
   void chunk_to_mesh_generator(const Location& loc);
-  void delete_furthest_chunk(const Location& loc);
+  void delete_furthest_chunk();
+  void mark_sent(const Location& loc);
+  Location get_player_location() const;
+  bool in_mesh_range(const Location& loc) const;
+  void evict_chunk(Location loc);
   std::array<Location, 6> get_adjacent_locations(const Location& loc) const;
-  void update_adjacent_chunks(const Int3D& coord);
-  bool set_voxel_if_possible(const Location& loc, int idx, Voxel voxel);
+  void remesh_around(const Int3D& coord, std::chrono::steady_clock::time_point edited);
 
-  std::unordered_map<Location, Chunk, LocationHash> chunks_;
-  std::unordered_set<Location, LocationHash> chunks_sent_;
+  ChunkGrid chunks_;
+  EvictionIndex<Location, LocationHash> chunks_sent_;
+  // loaded chunks that haven't been sent to the mesh generator
+  EvictionIndex<Location, LocationHash> chunks_unsent_;
   std::unordered_map<Location, int, LocationHash> adjacents_missing_;
   std::vector<Diff> diffs_;
   Player player_;
   std::unordered_set<Location, LocationHash> updated_since_reset_;
-  std::stack<CoordHistory> update_history_;
-  std::stack<int> update_sizes_;
+  UndoJournal undo_journal_;
   // has to be at least as big as max_sz
   static int max_sz_internal;
 };
@@ -0,0 +1,370 @@
+#include "region_chunk_store.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include "cs_math.h"
+
+// An open region file, its table and the mapping loads decode from
+struct RegionChunkStore::Region {
+  ~Region();
+  bool open(const std::string& path);
+  bool map();
+  void unmap();
+  bool resize(std::size_t sz);
+  bool write(std::size_t offset, const void* buf, std::size_t sz);
+  bool sync();
+
+#ifdef _WIN32
+  HANDLE file = INVALID_HANDLE_VALUE;
+  HANDLE mapping = nullptr;
+#else
+  int file = -1;
+#endif
+  std::size_t file_sz = 0;
+  const unsigned char* data = nullptr;
+  std::array<Entry, chunks_per_region> table{};
+  // which sectors are taken, only touched by stores
+  std::vector<bool> used;
+  // no sector before this one is free
+  std::size_t first_free = table_sectors;
+};
+
+#ifdef _WIN32
+RegionChunkStore::Region::~Region() {
+  unmap();
+  if (file != INVALID_HANDLE_VALUE)
+    CloseHandle(file);
+}
+
+bool RegionChunkStore::Region::open(const std::string& path) {
+  file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  LARGE_INTEGER sz;
+  if (file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &sz))
+    return false;
+  file_sz = sz.QuadPart;
+  return true;
+}
+
+bool RegionChunkStore::Region::map() {
+  mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  if (mapping == nullptr)
+    return false;
+  data = static_cast<const unsigned char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+  return data != nullptr;
+}
+
+void RegionChunkStore::Region::unmap() {
+  if (data != nullptr)
+    UnmapViewOfFile(data);
+  if (mapping != nullptr)
+    CloseHandle(mapping);
+  data = nullptr;
+  mapping = nullptr;
+}
+
+bool RegionChunkStore::Region::resize(std::size_t sz) {
+  LARGE_INTEGER offset;
+  offset.QuadPart = sz;
+  if (!SetFilePointerEx(file, offset, nullptr, FILE_BEGIN) || !SetEndOfFile(file))
+    return false;
+  file_sz = sz;
+  return true;
+}
+
+bool RegionChunkStore::Region::write(std::size_t offset, const void* buf, std::size_t sz) {
+  OVERLAPPED overlapped{};
+  overlapped.Offset = static_cast<DWORD>(offset);
+  overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+  DWORD written;
+  return WriteFile(file, buf, sz, &written, &overlapped) && written == sz;
+}
+
+bool RegionChunkStore::Region::sync() {
+  return FlushFileBuffers(file);
+}
+#else
+RegionChunkStore::Region::~Region() {
+  unmap();
+  if (file >= 0)
+    close(file);
+}
+
+bool RegionChunkStore::Region::open(const std::string& path) {
+  file = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (file < 0 || fstat(file, &st) != 0)
+    return false;
+  file_sz = st.st_size;
+  return true;
+}
+
+bool RegionChunkStore::Region::map() {
+  void* mapped = mmap(nullptr, file_sz, PROT_READ, MAP_SHARED, file, 0);
+  if (mapped == MAP_FAILED)
+    return false;
+  data = static_cast<const unsigned char*>(mapped);
+  return true;
+}
+
+void RegionChunkStore::Region::unmap() {
+  if (data != nullptr)
+    munmap(const_cast<unsigned char*>(data), file_sz);
+  data = nullptr;
+}
+
+bool RegionChunkStore::Region::resize(std::size_t sz) {
+  if (ftruncate(file, sz) != 0)
+    return false;
+  file_sz = sz;
+  return true;
+}
+
+bool RegionChunkStore::Region::write(std::size_t offset, const void* buf, std::size_t sz) {
+  auto* bytes = static_cast<const unsigned char*>(buf);
+  while (sz > 0) {
+    ssize_t written = pwrite(file, bytes, sz, offset);
+    if (written <= 0)
+      return false;
+    bytes += written;
+    offset += written;
+    sz -= written;
+  }
+  return true;
+}
+
+bool RegionChunkStore::Region::sync() {
+#ifdef __APPLE__
+  return fsync(file) == 0;
+#else
+  return fdatasync(file) == 0;
+#endif
+}
+#endif
+
+RegionChunkStore::RegionChunkStore(const std::string& dir) : dir_(dir) {
+  std::filesystem::create_directories(dir);
+}
+
+RegionChunkStore::~RegionChunkStore() = default;
+
+Location RegionChunkStore::get_region(const Location& loc) {
+  return {cs_math::floor_div(loc[0], region_sz), cs_math::floor_div(loc[1], region_sz), cs_math::floor_div(loc[2], region_sz)};
+}
+
+int RegionChunkStore::get_index(const Location& loc) {
+  auto region = get_region(loc);
+  int x = loc[0] - region[0] * region_sz;
+  int y = loc[1] - region[1] * region_sz;
+  int z = loc[2] - region[2] * region_sz;
+  return x + region_sz * (y + region_sz * z);
+}
+
+std::string RegionChunkStore::get_path(const Location& region) const {
+  return dir_ + "/r." + std::to_string(region[0]) + "." + std::to_string(region[1]) + "." +
+    std::to_string(region[2]) + ".region";
+}
+
+std::optional<StoredChunk> RegionChunkStore::load(const Location& loc) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  Region* region = get_region_file(get_region(loc), false);
+  if (region == nullptr)
+    return std::nullopt;
+  auto& entry = region->table[get_index(loc)];
+  if (entry.sector == 0)
+    return std::nullopt;
+  return decode(loc, region->data + std::size_t{entry.sector} * sector_sz, entry.size);
+}
+
+// Expects mutex_ to be held. Regions without a file are remembered as nullptr
+// until one is created.
+RegionChunkStore::Region* RegionChunkStore::get_region_file(const Location& region_loc, bool create) {
+  auto it = regions_.find(region_loc);
+  if (it != regions_.end() && (it->second != nullptr || !create))
+    return it->second.get();
+  auto path = get_path(region_loc);
+  if (!create && !std::filesystem::exists(path)) {
+    regions_[region_loc] = nullptr;
+    return nullptr;
+  }
+
+  auto region = std::make_unique<Region>();
+  std::size_t table_bytes = table_sectors * sector_sz;
+  if (!region->open(path) || (region->file_sz < table_bytes && !region->resize(table_bytes)) || !region->map()) {
+    std::cerr << "Failed to open region file " << path << std::endl;
+    return nullptr;
+  }
+  std::memcpy(region->table.data(), region->data, sizeof(region->table));
+  region->used.assign(region->file_sz / sector_sz, false);
+  std::fill_n(region->used.begin(), table_sectors, true);
+  for (auto& entry : region->table) {
+    if (entry.sector == 0)
+      continue;
+    std::size_t end = entry.sector + (entry.size + sector_sz - 1) / sector_sz;
+    if (entry.sector < table_sectors || end > region->used.size()) {
+      std::cerr << "Corrupt region file " << path << std::endl;
+      entry = {};
+      continue;
+    }
+    std::fill(region->used.begin() + entry.sector, region->used.begin() + end, true);
+  }
+  auto* result = region.get();
+  regions_[region_loc] = std::move(region);
+  return result;
+}
+
+void RegionChunkStore::store(const Batch& batch) {
+  std::unordered_map<Location, std::vector<std::pair<Location, const std::vector<unsigned char>*>>, LocationHash> by_region;
+  for (auto& [loc, blob] : batch)
+    by_region[get_region(loc)].push_back({loc, &blob});
+  for (auto& [region_loc, chunks] : by_region) {
+    Region* region;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      region = get_region_file(region_loc, true);
+    }
+    if (region != nullptr)
+      store_region(*region, chunks);
+  }
+}
+
+void RegionChunkStore::store_region(Region& region, const std::vector<std::pair<Location, const std::vector<unsigned char>*>>& chunks) {
+  std::vector<Entry> entries(chunks.size());
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+      std::uint32_t size = chunks[i].second->size();
+      entries[i] = {allocate(region, (size + sector_sz - 1) / sector_sz), size};
+    }
+  }
+
+  // nothing points at the new sectors yet, so loads can go on meanwhile
+  std::vector<Entry> unused;
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    auto& blob = *chunks[i].second;
+    if (entries[i].sector != 0 && !region.write(std::size_t{entries[i].sector} * sector_sz, blob.data(), blob.size())) {
+      std::cerr << "Failed to save chunk " << chunks[i].first << std::endl;
+      unused.push_back(entries[i]);
+      entries[i] = {};
+    }
+  }
+  // the blobs have to reach the disk before the table points at them
+  if (!region.sync()) {
+    std::cerr << "Failed to sync region file" << std::endl;
+    for (auto& entry : entries) {
+      if (entry.sector != 0)
+        unused.push_back(entry);
+    }
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto& entry : unused)
+      release(region, entry);
+    return;
+  }
+
+  std::vector<Entry> replaced;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for (auto& entry : unused)
+      release(region, entry);
+    for (std::size_t i = 0; i < chunks.size(); ++i) {
+      if (entries[i].sector == 0)
+        continue;
+      int idx = get_index(chunks[i].first);
+      if (!region.write(idx * sizeof(Entry), &entries[i], sizeof(Entry))) {
+        // the entry on disk may point at either blob, so both stay taken
+        std::cerr << "Failed to save chunk " << chunks[i].first << std::endl;
+        continue;
+      }
+      auto& entry = region.table[idx];
+      if (entry.sector != 0)
+        replaced.push_back(entry);
+      entry = entries[i];
+    }
+  }
+
+  // replaced sectors are only reused once the table no longer points at them
+  // on disk
+  if (replaced.empty())
+    return;
+  if (!region.sync()) {
+    std::cerr << "Failed to sync region file" << std::endl;
+    return;
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto& entry : replaced)
+    release(region, entry);
+}
+
+// Expects mutex_ to be held. Frees the sectors of a blob.
+void RegionChunkStore::release(Region& region, const Entry& entry) {
+  std::size_t sectors = (entry.size + sector_sz - 1) / sector_sz;
+  std::fill_n(region.used.begin() + entry.sector, sectors, false);
+  region.first_free = std::min(region.first_free, std::size_t{entry.sector});
+}
+
+// Expects mutex_ to be held. Takes the first run of free sectors that fits,
+// growing the file by half if there is none. Returns 0 on failure.
+std::uint32_t RegionChunkStore::allocate(Region& region, int sectors) {
+  auto& used = region.used;
+  while (region.first_free < used.size() && used[region.first_free])
+    ++region.first_free;
+  int run = 0;
+  for (std::size_t i = region.first_free; i < used.size(); ++i) {
+    run = used[i] ? 0 : run + 1;
+    if (run == sectors) {
+      std::size_t start = i + 1 - sectors;
+      std::fill_n(used.begin() + start, sectors, true);
+      return start;
+    }
+  }
+
+  // a free run at the end of the file is extended
+  std::size_t start = used.size() - run;
+  std::size_t count = std::max(start + sectors, used.size() + used.size() / 2);
+  region.unmap();
+  bool resized = region.resize(count * sector_sz);
+  if (!region.map() || !resized) {
+    std::cerr << "Failed to grow region file" << std::endl;
+    return 0;
+  }
+  used.resize(count, false);
+  std::fill_n(used.begin() + start, sectors, true);
+  return start;
+}
+
+std::vector<Location> RegionChunkStore::get_locations() {
+  std::vector<Location> locs;
+  for (auto& file : std::filesystem::directory_iterator(dir_)) {
+    Location region_loc;
+    auto name = file.path().filename().string();
+    if (std::sscanf(name.c_str(), "r.%d.%d.%d.region", &region_loc[0], &region_loc[1], &region_loc[2]) != 3)
+      continue;
+    std::unique_lock<std::mutex> lock(mutex_);
+    Region* region = get_region_file(region_loc, false);
+    if (region == nullptr)
+      continue;
+    for (int i = 0; i < chunks_per_region; ++i) {
+      if (region->table[i].sector == 0)
+        continue;
+      int x = i % region_sz;
+      int y = i / region_sz % region_sz;
+      int z = i / (region_sz * region_sz);
+      locs.push_back({region_loc[0] * region_sz + x, region_loc[1] * region_sz + y, region_loc[2] * region_sz + z});
+    }
+  }
+  return locs;
+}
@@ -0,0 +1,58 @@
+#ifndef REGION_CHUNK_STORE_H
+#define REGION_CHUNK_STORE_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "chunk_store.h"
+
+/*
+  Chunks grouped into region files of 16x16x16 chunks, so chunks near each
+  other are near each other on disk. A region file starts with a table giving
+  the first sector and size of each chunk's blob, followed by the blobs in
+  256 byte sectors. Files are memory mapped and loads decode straight from the
+  mapping.
+  A stored chunk is written to free sectors and synced before the table points
+  at it, so a load never sees half a blob and a crash or power cut mid-store
+  leaves the old copy in place. The sectors it replaces are reused by later
+  stores once the new table entry is synced too.
+*/
+class RegionChunkStore : public ChunkStore {
+public:
+  static constexpr int region_sz = 16;
+  static constexpr int chunks_per_region = region_sz * region_sz * region_sz;
+  static constexpr int sector_sz = 256;
+
+  explicit RegionChunkStore(const std::string& dir);
+  ~RegionChunkStore();
+  std::optional<StoredChunk> load(const Location& loc) override;
+  void store(const Batch& batch) override;
+  std::vector<Location> get_locations() override;
+
+  static Location get_region(const Location& loc);
+
+private:
+  struct Region;
+  struct Entry {
+    // 0 where the chunk isn't stored, as the table itself is there
+    std::uint32_t sector;
+    std::uint32_t size;
+  };
+  static constexpr int table_sectors = chunks_per_region * sizeof(Entry) / sector_sz;
+
+  static int get_index(const Location& loc);
+  std::string get_path(const Location& region) const;
+  Region* get_region_file(const Location& region, bool create);
+  void store_region(Region& region, const std::vector<std::pair<Location, const std::vector<unsigned char>*>>& chunks);
+  std::uint32_t allocate(Region& region, int sectors);
+  void release(Region& region, const Entry& entry);
+
+  std::string dir_;
+  std::unordered_map<Location, std::unique_ptr<Region>, LocationHash> regions_;
+  // held by loads, and by stores while they open, grow or point the table at
+  // what they wrote
+  std::mutex mutex_;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "renderer.h"
 #include <algorithm>
+#include <chrono>
 #include <cmath>
 #include <fstream>
 #include <iostream>
@@ -16,7 +17,8 @@
 double Renderer::aspect_ratio = Options::window_width / static_cast<double>(Options::window_height);
 double Renderer::fov = glm::radians(45.);
 double Renderer::near_plane = .1;
-double Renderer::far_plane = 1000.;
+// the heightfield reaches 8 km out, a little more in the corners
+double Renderer::far_plane = 12000.;
 int Renderer::shadow_res = 2048;
 GLuint Renderer::blur_texture_width = Options::window_width / 8;
 GLuint Renderer::blur_texture_height = Options::window_height / 8;
@@ -240,7 +242,15 @@ void Renderer::consume_mesh_generator(MeshGenerator& mesh_generator) {
   for (auto& diff : diffs) {
     auto& loc = diff.location;
     if (diff.kind == MeshGenerator::Diff::creation) {
-      terrain_.create(loc, mesh_generator);
+      SlabLocation slab_loc{loc, diff.slab};
+      auto slab_mesh = mesh_generator.take_mesh(slab_loc);
+      terrain_.create(slab_loc, slab_mesh);
+      MeshGenerator::recycle(std::move(slab_mesh));
+      if (diff.edited != std::chrono::steady_clock::time_point{}) {
+        auto now = std::chrono::steady_clock::now();
+        float latency_ms = std::chrono::duration<float, std::milli>(now - diff.edited).count();
+        average_edit_latency_ms_ = average_edit_latency_ms_ == 0.f ? latency_ms : 0.8f * average_edit_latency_ms_ + 0.2f * latency_ms;
+      }
     } else if (diff.kind == MeshGenerator::Diff::deletion) {
       terrain_.destroy(loc);
     } else if (diff.kind == MeshGenerator::Diff::origin) {
@@ -255,13 +265,20 @@ void Renderer::consume_lod_mesh_generator(LodMeshGenerator& lod_mesh_generator)
   auto& diffs = lod_mesh_generator.get_diffs();
   for (auto& diff : diffs) {
     auto& loc = diff.location;
-    if (diff.kind == LodMeshGenerator::Diff::creation) {
-      auto level = std::any_cast<const LodMeshGenerator::Diff::CreationData&>(diff.data).level;
-    }
+    if (diff.kind == LodMeshGenerator::Diff::creation)
+      terrain_.create_lod(loc, diff.level, lod_mesh_generator.take_mesh(loc));
+    else if (diff.kind == LodMeshGenerator::Diff::deletion)
+      terrain_.destroy_lod(loc);
   }
   lod_mesh_generator.clear_diffs();
 }
 
+void Renderer::consume_heightfield(HeightfieldClipmap& heightfield) {
+  for (auto& level_mesh : heightfield.get_meshes())
+    terrain_.create_heightfield_level(level_mesh);
+  heightfield.clear_meshes();
+}
+
 void Renderer::consume_camera(const Camera& camera) {
   view_ = camera.get_view(world_offset_);
   camera_offset_position_ = camera.get_position(world_offset_);
@@ -291,6 +308,8 @@ void Renderer::render_scene() {
   glBindFramebuffer(GL_FRAMEBUFFER, main_fbo_);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   terrain_.render(*this);
+  terrain_.render_lods(*this);
+  terrain_.render_heightfield(*this);
   glDepthFunc(GL_LEQUAL);
   glDisable(GL_BLEND);
   ssao();
@@ -593,6 +612,10 @@ const glm::vec3& Renderer::get_camera_offset_position() const {
   return camera_offset_position_;
 }
 
+float Renderer::get_average_edit_latency_ms() const {
+  return average_edit_latency_ms_;
+}
+
 UIGraphics& Renderer::get_ui_graphics() {
   return ui_graphics_;
 }
@@ -2,9 +2,11 @@
 #define RENDERER_H
 
 #include <array>
+#include <atomic>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "camera.h"
+#include "heightfield_clipmap.h"
 #include "lod_mesh_generator.h"
 #include "mesh_generator.h"
 #include "region.h"
@@ -76,6 +78,7 @@ public:
   Renderer(Sim& sim);
   void consume_mesh_generator(MeshGenerator& mesh_generator);
   void consume_lod_mesh_generator(LodMeshGenerator& lod_mesh_generator);
+  void consume_heightfield(HeightfieldClipmap& heightfield);
   void consume_camera(const Camera& camera);
   void render_scene();
   void render(const DrawCommand& command);
@@ -86,6 +89,8 @@ public:
   Sky& get_sky();
   UIGraphics& get_ui_graphics();
   const Camera& get_camera() const;
+  // time from a voxel edit to its slabs being uploaded, averaged
+  float get_average_edit_latency_ms() const;
 
   std::uint32_t register_scene_component(const SceneComponent& scene_component);
   void upload_buffer_data(std::uint32_t component_id, BufferType buffer_type, unsigned int offset, unsigned int size, const void* data);
@@ -180,6 +185,7 @@ private:
 
   std::uint32_t next_component_id_ = 0;
   unsigned int frame_ = 0;
+  std::atomic<float> average_edit_latency_ms_ = 0.f;
 };
 
 #endif
\ No newline at end of file
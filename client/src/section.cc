@@ -1,6 +1,8 @@
 #include "section.h"
+#include <algorithm>
+#include <cstdlib>
 #include "chunk.h"
-#include "region.h"
+#include "cs_math.h"
 
 Section::Section(const fbs_update::Section* section) {
   auto loc = section->location();
@@ -12,6 +14,11 @@ Section::Section(const fbs_update::Section* section) {
     landcover_.push_back(static_cast<common::LandCover>(section->landcover()->Get(i)));
 }
 
+Section::Section(const Location2D& location, int elevation, const std::vector<common::LandCover>& landcover)
+  : location_(location), elevation_(elevation), landcover_(landcover) {
+  subsection_elevations_.reserve(sz);
+}
+
 const Location2D& Section::get_location() const {
   return location_;
 }
@@ -29,25 +36,25 @@ void Section::set_elevation(int elevation) {
 }
 
 // Assume only called when all neighbouring sections are present
-void Section::compute_subsection_elevations(std::unordered_map<Location2D, Section, Location2DHash>& sections) {
+void Section::compute_subsection_elevations(const SectionMap& sections) {
   // subsection_elevations_.assign(sz, elevation_);
 
   Location2D loc{location_[0] - 1, location_[1] + 1};
-  int e1 = sections.at(loc).elevation_;
+  int e1 = sections.at(loc)->elevation_;
   loc[0]++;
-  int e2 = sections.at(loc).elevation_;
+  int e2 = sections.at(loc)->elevation_;
   loc[0]++;
-  int e3 = sections.at(loc).elevation_;
+  int e3 = sections.at(loc)->elevation_;
   loc[1]--;
-  int e4 = sections.at(loc).elevation_;
+  int e4 = sections.at(loc)->elevation_;
   loc[1]--;
-  int e5 = sections.at(loc).elevation_;
+  int e5 = sections.at(loc)->elevation_;
   loc[0]--;
-  int e6 = sections.at(loc).elevation_;
+  int e6 = sections.at(loc)->elevation_;
   loc[0]--;
-  int e7 = sections.at(loc).elevation_;
+  int e7 = sections.at(loc)->elevation_;
   loc[1]++;
-  int e8 = sections.at(loc).elevation_;
+  int e8 = sections.at(loc)->elevation_;
 
   // e1 | e2 | e3
   // e8 | e  | e4
@@ -86,12 +93,6 @@ void Section::compute_subsection_elevations(std::unordered_map<Location2D, Secti
       subsection_elevations_.push_back(n_xy);
     }
   }
-
-  computed_subsection_elevations_ = true;
-}
-
-bool Section::has_subsection_elevations() const {
-  return computed_subsection_elevations_;
 }
 
 const std::vector<int>& Section::get_subsection_elevations() const {
@@ -108,21 +109,30 @@ common::LandCover Section::get_landcover(int x, int z) const {
   return landcover_[col + row * common::landcover_cols_per_sector];
 }
 
+// Expects x and z within a column of this section's
 void Section::insert_into_features(int x, int y, int z, Voxel voxel) {
-  auto location = Region::location_from_global_coord(x, y, z);
-  auto& location_features = features_[location];
-  int idx = Chunk::get_index(Chunk::to_local(Int3D{x, y, z}));
-  location_features.emplace_back(std::make_pair(idx, voxel));
+  int column_x = cs_math::floor_div(x, sz_x);
+  int column_z = cs_math::floor_div(z, sz_z);
+  int chunk_y = cs_math::floor_div(y, Chunk::sz_y);
+  int idx = Chunk::get_index(x - column_x * sz_x, y - chunk_y * Chunk::sz_y, z - column_z * sz_z);
+  int column = (column_x - location_[0] + 1) + 3 * (column_z - location_[1] + 1);
+  features_[column].push_back(Feature{chunk_y, static_cast<std::uint16_t>(idx), voxel});
 }
 
-void Section::set_features_loaded(bool loaded) {
-  features_loaded_ = loaded;
+// Stable, so where features overlap the last inserted still wins
+void Section::finish_features() {
+  for (auto& column : features_) {
+    std::ranges::stable_sort(column, {}, &Feature::chunk_y);
+    column.shrink_to_fit();
+  }
 }
 
-bool Section::is_features_loaded() const {
-  return features_loaded_;
+std::span<const Section::Feature> Section::get_features(const Location& location) const {
+  int dx = location[0] - location_[0];
+  int dz = location[2] - location_[1];
+  if (std::abs(dx) > 1 || std::abs(dz) > 1)
+    return {};
+  auto& column = features_[(dx + 1) + 3 * (dz + 1)];
+  auto [first, last] = std::ranges::equal_range(column, location[1], {}, &Feature::chunk_y);
+  return {first, last};
 }
-
-std::vector<std::pair<int, Voxel>>& Section::get_features(const Location& location) {
-  return features_[location];
-}
\ No newline at end of file
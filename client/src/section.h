@@ -1,32 +1,55 @@
 #ifndef SECTION_H
 #define SECTION_H
 
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <span>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include "update_generated.h"
 #include "common.h"
 #include "types.h"
 
+class Section;
+using SectionMap = std::unordered_map<Location2D, std::shared_ptr<Section>, Location2DHash>;
+
 class Section {
 public:
   static constexpr int sz_x = common::chunk_sz_x;
   static constexpr int sz_z = common::chunk_sz_z;
   static constexpr int sz = common::chunk_sz_x * common::chunk_sz_z;
 
+  // a voxel placed over the terrain, in the chunk chunk_y up a column
+  struct Feature {
+    int chunk_y;
+    std::uint16_t idx;
+    Voxel voxel;
+  };
+
   Section(const fbs_update::Section* section);
+  Section(const Location2D& location, int elevation, const std::vector<common::LandCover>& landcover);
   const Location2D& get_location() const;
   int get_elevation() const;
   const std::vector<common::LandCover>& get_landcover() const;
   common::LandCover get_landcover(int x, int z) const;
   void set_elevation(int elevation);
-  void compute_subsection_elevations(std::unordered_map<Location2D, Section, Location2DHash>& sections);
-  bool has_subsection_elevations() const;
+  void compute_subsection_elevations(const SectionMap& sections);
   const std::vector<int>& get_subsection_elevations() const;
   int get_subsection_elevation(int x, int z) const;
   void insert_into_features(int x, int y, int z, Voxel voxel);
-  void set_features_loaded(bool loaded);
-  bool is_features_loaded() const;
-  std::vector<std::pair<int,Voxel>>& get_features(const Location& location);
+  // Puts the features in chunk order, once all have been inserted
+  void finish_features();
+  // the features in location's chunk, in the order they were inserted
+  std::span<const Feature> get_features(const Location& location) const;
+
+  // Runs prepare the first time any thread asks, the others wait for it to finish
+  template <typename F>
+  void prepare_once(F&& prepare) {
+    std::call_once(prepared_, std::forward<F>(prepare));
+  }
 
 private:
   Location2D location_;
@@ -34,10 +57,11 @@ private:
   std::vector<common::LandCover> landcover_;
 
   std::vector<int> subsection_elevations_;
-  bool computed_subsection_elevations_ = false;
 
-  std::unordered_map<Location, std::vector<std::pair<int, Voxel>>, LocationHash> features_;
-  bool features_loaded_ = false;
+  // features reach into the neighbouring columns, these are each of the nine
+  // columns' features sorted by chunk
+  std::array<std::vector<Feature>, 9> features_;
+  std::once_flag prepared_;
 };
 
 #endif
@@ -1,5 +1,7 @@
 #include "sim.h"
+#include <algorithm>
 #include <chrono>
+#include <cstdlib>
 #include <iomanip>
 #include <iostream>
 #include <limits>
@@ -61,26 +63,13 @@ Sim::Sim(GLFWwindow* window, TCPClient& tcp_client)
 }
 
 void Sim::stream_chunks() {
-  int num_new_chunks = 0;
-  auto stream_column = [this, &num_new_chunks](Location column) -> void {
+  auto stream_column = [this](Location column) -> bool {
     for (int y = render_min_y_offset; y <= render_max_y_offset; ++y) {
       auto location = Location{column[0], column[1] + y, column[2]};
-      if (!region_.has_chunk(location) && world_generator_.ready_to_fill(location, sections_)) {
-        std::optional<Chunk> chunk;
-        auto possible_chunk = db_manager_.load_chunk_if_exists(location);
-
-        if (possible_chunk.has_value()) {
-          chunk = possible_chunk.value();
-        } else {
-          chunk.emplace(location[0], location[1], location[2]);
-          world_generator_.fill_chunk(*chunk, sections_);
-        }
-        region_.add_chunk(std::move(*chunk));
-
-        if (++num_new_chunks == max_chunks_to_stream_per_step)
-          return;
-      }
+      if (!region_.has_chunk(location) && world_generator_.ready_to_fill(location, sections_) && !stream_chunk(location))
+        return false;
     }
+    return true;
   };
 
   auto& player = region_.get_player();
@@ -95,28 +84,163 @@ void Sim::stream_chunks() {
 
   for (int r = 0; r <= region_distance; ++r) {
     Location column = Location{loc[0] - r, loc[1], loc[2] - r};
-    stream_column(column);
-    if (num_new_chunks == max_chunks_to_stream_per_step)
+    if (!stream_column(column))
       return;
     for (int i = 0; i < 3; ++i) {
       auto mods = column_modifiers[i];
       for (int moves = 0; moves < 2 * r; ++moves) {
         column[0] += mods.first;
         column[2] += mods.second;
-        stream_column(column);
-        if (num_new_chunks == max_chunks_to_stream_per_step)
+        if (!stream_column(column))
           return;
       }
     }
     for (int moves = 0; moves < 2 * r - 1; ++moves) {
       --column[2];
-      stream_column(column);
-      if (num_new_chunks == max_chunks_to_stream_per_step)
+      if (!stream_column(column))
         return;
     }
   }
 }
 
+// Queues every chunk streaming will want next with the loader, nearest first
+void Sim::prefetch_chunks(const Location& loc) {
+  std::vector<Location> locs;
+  for (int r = 0; r <= lod_distance; ++r) {
+    for (int dz = -r; dz <= r; ++dz) {
+      // only the first and last rows of the ring are full
+      int dx_step = (dz == -r || dz == r) ? 1 : 2 * r;
+      for (int dx = -r; dx <= r; dx += dx_step) {
+        for (int y = render_min_y_offset; y <= render_max_y_offset; ++y) {
+          auto location = Location{loc[0] + dx, loc[1] + y, loc[2] + dz};
+          bool streamed = r <= region_distance ? region_.has_chunk(location) : lod_loader_.has_lods(location);
+          if (!streamed)
+            locs.push_back(location);
+        }
+      }
+    }
+  }
+  db_manager_.prefetch(locs);
+}
+
+// Adds the chunk stored at location, or has a worker generate it. Stored
+// chunks only come from the loader, so nothing happens until it has loaded the
+// location or found nothing stored there. Returns false once the workers have
+// all the chunks they can take or the step is out of time.
+bool Sim::stream_chunk(const Location& location) {
+  if (is_streaming_done())
+    return false;
+  if (generating_.contains(location))
+    return true;
+  std::optional<StoredChunk> stored;
+  if (!db_manager_.take_prefetched(location, stored))
+    return true;
+  if (stored.has_value() && std::holds_alternative<Chunk>(*stored)) {
+    add_streamed_chunk(std::move(std::get<Chunk>(*stored)));
+    return true;
+  }
+
+  std::optional<ChunkEdits> edits;
+  if (stored.has_value())
+    edits = std::move(std::get<ChunkEdits>(*stored));
+  // evicting sections doesn't pull them out from under the worker
+  auto sections = std::make_shared<const SectionMap>(world_generator_.get_sections_to_fill(location, sections_));
+  generating_.insert(location);
+  JobSystem::instance()->submit([this, location, sections, edits = std::move(edits)](int worker) {
+    Chunk chunk(location[0], location[1], location[2]);
+    world_generator_.fill_chunk(chunk, *sections);
+    if (edits.has_value())
+      edits->apply(chunk);
+    generated_chunks_.push(worker, std::move(chunk));
+  });
+  return true;
+}
+
+bool Sim::is_streaming_done() {
+  std::size_t max_generating = max_chunks_generating_per_worker * JobSystem::instance()->get_num_workers();
+  return generating_.size() >= max_generating || std::chrono::steady_clock::now() >= stream_deadline_;
+}
+
+// Chunks that arrive after the player has moved on are dropped once out of range
+void Sim::add_streamed_chunk(Chunk&& chunk) {
+  auto location = chunk.get_location();
+  auto player_loc = Chunk::pos_to_loc(region_.get_player().get_position());
+  int d = std::max(std::abs(location[0] - player_loc[0]), std::abs(location[2] - player_loc[2]));
+  int dy = location[1] - player_loc[1];
+  if (d > lod_distance || dy < render_min_y_offset || dy > render_max_y_offset)
+    return;
+  lod_loader_.create_lods(chunk);
+  if (d <= region_distance && !region_.has_chunk(location))
+    region_.add_chunk(std::move(chunk));
+}
+
+void Sim::add_generated_chunks() {
+  std::optional<Chunk> chunk;
+  while (std::chrono::steady_clock::now() < stream_deadline_ && generated_chunks_.try_pop(chunk)) {
+    generating_.erase(chunk->get_location());
+    add_streamed_chunk(std::move(*chunk));
+  }
+}
+
+// The whole chunk is queued straight away. With the edit log on, a worker
+// then diffs it against what the generator makes there, and a chunk only a
+// few voxels away is saved again as just those voxels, unless it has been
+// saved since.
+void Sim::save_chunk(const Chunk& chunk) {
+  db_manager_.save_chunk(chunk);
+  auto location = chunk.get_location();
+  if (!DbManager::edit_log || !world_generator_.ready_to_fill(location, sections_))
+    return;
+  auto save = ++num_saves_;
+  diffing_[location] = save;
+  auto sections = std::make_shared<const SectionMap>(world_generator_.get_sections_to_fill(location, sections_));
+  auto edited = std::make_shared<const Chunk>(chunk);
+  JobSystem::instance()->submit([this, location, save, sections, edited](int worker) {
+    Chunk generated(location[0], location[1], location[2]);
+    world_generator_.fill_chunk(generated, *sections);
+    diffed_chunks_.push(worker, DiffedChunk{location, save, ChunkEdits::diff(*edited, generated)});
+  });
+}
+
+void Sim::save_diffed_chunks() {
+  DiffedChunk diffed;
+  while (diffed_chunks_.try_pop(diffed)) {
+    auto it = diffing_.find(diffed.location);
+    if (it == diffing_.end() || it->second != diffed.save)
+      continue;
+    diffing_.erase(it);
+    if (diffed.edits.has_value())
+      db_manager_.save_chunk_edits(*diffed.edits);
+  }
+}
+
+// Streams the chunks past the region, ring by ring outwards. They are only
+// kept long enough to build their lods.
+void Sim::stream_lods() {
+  auto loc = Chunk::pos_to_loc(region_.get_player().get_position());
+  for (; lod_stream_radius_ <= lod_distance; ++lod_stream_radius_) {
+    int r = lod_stream_radius_;
+    bool ring_done = true;
+    for (int dz = -r; dz <= r; ++dz) {
+      // only the first and last rows of the ring are full
+      int dx_step = (dz == -r || dz == r) ? 1 : 2 * r;
+      for (int dx = -r; dx <= r; dx += dx_step) {
+        for (int y = render_min_y_offset; y <= render_max_y_offset; ++y) {
+          auto location = Location{loc[0] + dx, loc[1] + y, loc[2] + dz};
+          if (lod_loader_.has_lods(location))
+            continue;
+          if (world_generator_.ready_to_fill(location, sections_) && !stream_chunk(location))
+            return;
+          if (!lod_loader_.has_lods(location))
+            ring_done = false;
+        }
+      }
+    }
+    if (!ring_done)
+      return;
+  }
+}
+
 void Sim::step(std::int64_t ms) {
   bool new_sections = false;
   Message message;
@@ -129,37 +253,31 @@ void Sim::step(std::int64_t ms) {
       new_sections = true;
       auto* region = update->kind_as_Region();
       auto* sections = region->sections();
+      auto player_loc = Chunk::pos_to_loc(region_.get_player().get_position());
       for (int i = 0; i < sections->size(); ++i) {
         auto* section_update = sections->Get(i);
         auto* loc = section_update->location();
         auto x = loc->x(), z = loc->y();
         auto location = Location2D{x, z};
+        requested_sections_.erase(location);
+        auto section = std::make_shared<Section>(section_update);
+        heightfield_.add_sample(*section);
+        // sections past this were only requested for the heightfield
+        if (std::abs(x - player_loc[0]) > section_distance || std::abs(z - player_loc[2]) > section_distance)
+          continue;
         if (!sections_.contains(location)) {
-          sections_.insert({location, Section(section_update)});
-          requested_sections_.erase(location);
+          sections_.insert({location, std::move(section)});
+          section_index_.insert(location);
         }
       }
       if (sections_.size() > max_sections) {
-        std::vector<Location2D> section_locs;
-        section_locs.reserve(sections_.size());
-        for (auto& [location, _] : sections_)
-          section_locs.push_back(location);
         auto& player = region_.get_player();
         auto& pos = player.get_position();
         auto loc = Chunk::pos_to_loc(pos);
-        auto player_location2d = Location2D{loc[0], loc[2]};
-        std::sort(
-          section_locs.begin(), section_locs.end(),
-          [&player_location2d](const Location2D l1, const Location2D l2) {
-            auto d1 = LocationMath::distance(l1, player_location2d);
-            auto d2 = LocationMath::distance(l2, player_location2d);
-            return d1 > d2;
-          });
+        section_index_.set_center(Location2D{loc[0], loc[2]});
         int to_remove = sections_.size() - max_sections;
-        for (int i = 0; i < to_remove; ++i) {
-          auto& location = section_locs[i];
-          sections_.erase(location);
-        }
+        for (int i = 0; i < to_remove; ++i)
+          sections_.erase(section_index_.pop_farthest());
       }
     } break;
     }
@@ -179,10 +297,24 @@ void Sim::step(std::int64_t ms) {
           locs.push_back(location);
       }
     }
+    heightfield_.set_center(Location2D{loc[0], loc[2]});
+    for (auto& location : heightfield_.get_missing_samples()) {
+      if (sections_.contains(location))
+        heightfield_.add_sample(*sections_.at(location));
+      else if (!requested_sections_.contains(location))
+        locs.push_back(location);
+    }
     if (locs.size() > 0)
       request_sections(locs);
+    region_.update_meshes();
+    lod_loader_.set_center(loc);
+    lod_stream_radius_ = region_distance + 1;
+    prefetch_chunks(loc);
   }
+  stream_deadline_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(stream_budget_ms);
+  add_generated_chunks();
   stream_chunks();
+  stream_lods();
   player.set_last_location(loc);
 
   auto process_inputs = [this](auto& event_queue, InputEvent::Kind input_event_kind) {
@@ -250,15 +382,18 @@ void Sim::step(std::int64_t ms) {
     std::unique_lock<std::mutex> lock(mesh_mutex_);
     mesh_generator_.consume_region(region_);
     lod_mesh_generator_.consume_lod_loader(lod_loader_);
+    heightfield_.update();
     ready_to_mesh_ = false;
   }
 
+  save_diffed_chunks();
   auto& updated_since_reset = region_.get_updated_since_reset();
   for (auto& loc : updated_since_reset) {
     if (!region_.has_chunk(loc))
       continue;
     auto& chunk = region_.get_chunk(loc);
-    db_manager_.save_chunk(chunk);
+    save_chunk(chunk);
+    lod_loader_.create_lods(chunk);
   }
   region_.reset_updated_since_reset();
 
@@ -266,6 +401,14 @@ void Sim::step(std::int64_t ms) {
 }
 
 void Sim::request_sections(std::vector<Location2D>& locs) {
+  for (std::size_t first = 0; first < locs.size(); first += max_sections_per_request) {
+    std::size_t last = std::min(locs.size(), first + max_sections_per_request);
+    std::vector<Location2D> batch(locs.begin() + first, locs.begin() + last);
+    request_section_batch(batch);
+  }
+}
+
+void Sim::request_section_batch(std::vector<Location2D>& locs) {
   flatbuffers::FlatBufferBuilder builder(common::max_msg_buffer_size);
 
   std::vector<fbs_common::Location2D> locations;
@@ -290,6 +433,7 @@ void Sim::request_sections(std::vector<Location2D>& locs) {
 }
 
 void Sim::draw(std::int64_t ms) {
+  auto start = std::chrono::high_resolution_clock::now();
   WindowEvent event;
   bool success = window_events_.try_dequeue(event);
   while (success) {
@@ -319,19 +463,26 @@ void Sim::draw(std::int64_t ms) {
     if (suc) {
       renderer_.consume_mesh_generator(mesh_generator_);
       renderer_.consume_lod_mesh_generator(lod_mesh_generator_);
+      renderer_.consume_heightfield(heightfield_);
       ready_to_mesh_ = true;
       mesh_mutex_.unlock();
     }
   }
   cv_.notify_one();
   render_modes_.cur->render();
+
+  auto end = std::chrono::high_resolution_clock::now();
+  float draw_ms = std::chrono::duration<float, std::milli>(end - start).count();
+  average_draw_ms_ = 0.95f * average_draw_ms_ + 0.05f * draw_ms;
 }
 
 void Sim::exit() {
   ready_to_mesh_ = true;
   cv_.notify_one();
+  JobSystem::instance()->stop();
 }
 void Sim::save() {
+  db_manager_.flush();
   db_manager_.save_camera(render_modes_.cur->get_camera());
 }
 
@@ -353,4 +504,5 @@ Sim::RenderModes& Sim::get_render_modes() { return render_modes_; }
 WorldEditor& Sim::get_world_editor() { return world_editor_; }
 DrawGenerator& Sim::get_draw_generator() { return draw_generator_; }
 World& Sim::get_world() { return world_; }
-WorldGenerator& Sim::get_world_generator() { return world_generator_; }
\ No newline at end of file
+WorldGenerator& Sim::get_world_generator() { return world_generator_; }
+float Sim::get_average_draw_ms() const { return average_draw_ms_; }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef SIM_H
 #define SIM_H
 
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
@@ -11,7 +12,10 @@
 #include "camera.h"
 #include "db_manager.h"
 #include "draw_generator.h"
+#include "eviction_index.h"
 #include "first_person_render_mode.h"
+#include "heightfield_clipmap.h"
+#include "job_system.h"
 #include "lod_loader.h"
 #include "lod_mesh_generator.h"
 #include "mesh_generator.h"
@@ -72,18 +76,44 @@ public:
   WorldEditor& get_world_editor();
   DrawGenerator& get_draw_generator();
   WorldGenerator& get_world_generator();
+  float get_average_draw_ms() const;
 
   static constexpr int render_min_y_offset = -2;
   static constexpr int render_max_y_offset = 2;
   static constexpr int region_distance = 4;
-  static constexpr int section_distance = region_distance + 3;
+  // chunks are streamed out to here just to build lods, one ring past the last
+  // ring drawn so that it has all its neighbours
+  static constexpr int lod_distance = LodLoader::ring_distances.back() + 1;
+  static constexpr int section_distance = lod_distance + 3;
   static constexpr int max_sections = 2 * 4 * section_distance * section_distance;
   static constexpr int frame_rate_target = 60;
-  static constexpr int max_chunks_to_stream_per_step = 5;
+  // chunks being generated by the workers at once
+  static constexpr int max_chunks_generating_per_worker = 4;
+  // time each step spends adding streamed chunks to the region and lod loader
+  static constexpr int stream_budget_ms = 4;
+  // each request's reply has to fit in one message
+  static constexpr int max_sections_per_request = 128;
+  static_assert(LodLoader::full_detail_distance == region_distance - 1, "lods start where full detail meshes end");
+  static_assert(LodLoader::full_detail_distance == Region::mesh_distance, "lods start where full detail meshes end");
+  static_assert(LodLoader::ring_distances.back() == lod_distance - 1, "lods are drawn one ring inside the streamed ones");
+  static_assert(LodLoader::max_dy == render_max_y_offset && -LodLoader::max_dy == render_min_y_offset);
+  static_assert(ChunkGrid::size_x > 2 * region_distance + 1 && ChunkGrid::size_z > 2 * region_distance + 1,
+                "the chunk grid has to be wider than the streamed region");
+  static_assert(ChunkGrid::size_y > render_max_y_offset - render_min_y_offset + 1,
+                "the chunk grid has to be taller than the streamed region");
 
 private:
   void request_sections(std::vector<Location2D>& locs);
+  void request_section_batch(std::vector<Location2D>& locs);
   void stream_chunks();
+  void stream_lods();
+  void prefetch_chunks(const Location& loc);
+  bool stream_chunk(const Location& location);
+  void add_streamed_chunk(Chunk&& chunk);
+  void add_generated_chunks();
+  bool is_streaming_done();
+  void save_chunk(const Chunk& chunk);
+  void save_diffed_chunks();
 
   GLFWwindow* window_;
   TCPClient& tcp_client_;
@@ -94,6 +124,7 @@ private:
   WorldEditor world_editor_;
   MeshGenerator mesh_generator_;
   LodMeshGenerator lod_mesh_generator_;
+  HeightfieldClipmap heightfield_;
   Renderer renderer_;
   DrawGenerator draw_generator_;
   UI ui_;
@@ -109,11 +140,27 @@ private:
   bool ready_to_mesh_ = true;
 
   std::unordered_set<Location2D, Location2DHash> requested_sections_;
-  std::unordered_map<Location2D, Section, Location2DHash> sections_;
+  SectionMap sections_;
+  EvictionIndex<Location2D, Location2DHash> section_index_;
   Int3D ray_collision_;
   moodycamel::ReaderWriterQueue<WindowEvent> window_events_;
   bool player_controlled_ = true;
   std::uint64_t step_ = 0;
+  // rings closer than this all have lods
+  int lod_stream_radius_ = region_distance + 1;
+  std::unordered_set<Location, LocationHash> generating_;
+  CompletionQueue<std::optional<Chunk>> generated_chunks_;
+  std::chrono::steady_clock::time_point stream_deadline_;
+  struct DiffedChunk {
+    Location location;
+    std::uint64_t save;
+    std::optional<ChunkEdits> edits;
+  };
+  // latest save of each chunk being diffed against the generator
+  std::unordered_map<Location, std::uint64_t, LocationHash> diffing_;
+  std::uint64_t num_saves_ = 0;
+  CompletionQueue<DiffedChunk> diffed_chunks_;
+  std::atomic<float> average_draw_ms_ = 0.f;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,94 @@
+#include "sqlite_chunk_store.h"
+
+#include <iostream>
+#include <stdexcept>
+
+SqliteChunkStore::SqliteChunkStore(const std::string& path) {
+  db_ = open(path);
+  std::string sql =
+    "create table if not exists Chunk("
+    "\tx integer not null,"
+    "\ty integer not null,"
+    "\tz integer not null,"
+    "\tdata blob,"
+    "\tprimary key (x,y,z)"
+    ");";
+  char* err_msg;
+  if (sqlite3_exec(db_, sql.c_str(), nullptr, nullptr, &err_msg)) {
+    std::cerr << "Failed to create table: " << err_msg << std::endl;
+    sqlite3_free(err_msg);
+    throw std::runtime_error("Failed to open chunk database");
+  }
+  load_stmt_ = prepare(db_, "select data from Chunk where x = ? and y = ? and z = ?;");
+
+  writer_db_ = open(path);
+  store_stmt_ = prepare(writer_db_, "insert or replace into Chunk(x,y,z,data) values(?,?,?,?);");
+}
+
+SqliteChunkStore::~SqliteChunkStore() {
+  sqlite3_finalize(store_stmt_);
+  sqlite3_close(writer_db_);
+  sqlite3_finalize(load_stmt_);
+  sqlite3_close(db_);
+}
+
+sqlite3* SqliteChunkStore::open(const std::string& path) {
+  sqlite3* db;
+  int failure = sqlite3_open(path.c_str(), &db);
+  if (failure) {
+    std::cerr << "Failed to open database: " << sqlite3_errmsg(db) << std::endl;
+    throw std::runtime_error("Failed to open database");
+  }
+  // with WAL, commits only sync at checkpoints and readers never block the
+  // writer. A commit can be lost to a power cut but not to a crash.
+  sqlite3_exec(db, "pragma journal_mode=WAL; pragma synchronous=NORMAL;", nullptr, nullptr, nullptr);
+  sqlite3_busy_timeout(db, 1000);
+  return db;
+}
+
+sqlite3_stmt* SqliteChunkStore::prepare(sqlite3* db, const std::string& sql) {
+  sqlite3_stmt* stmt;
+  if (sqlite3_prepare_v2(db, sql.c_str(), -1, &stmt, nullptr) != SQLITE_OK) {
+    std::cerr << "Failed to prepare statement: " << sqlite3_errmsg(db) << std::endl;
+    throw std::runtime_error("Failed to open database");
+  }
+  return stmt;
+}
+
+std::optional<StoredChunk> SqliteChunkStore::load(const Location& loc) {
+  sqlite3_bind_int(load_stmt_, 1, loc[0]);
+  sqlite3_bind_int(load_stmt_, 2, loc[1]);
+  sqlite3_bind_int(load_stmt_, 3, loc[2]);
+  std::optional<StoredChunk> chunk;
+  if (sqlite3_step(load_stmt_) == SQLITE_ROW) {
+    const unsigned char* data = static_cast<const unsigned char*>(sqlite3_column_blob(load_stmt_, 0));
+    int data_size = sqlite3_column_bytes(load_stmt_, 0);
+    chunk = decode(loc, data, data_size);
+  }
+  sqlite3_reset(load_stmt_);
+  return chunk;
+}
+
+void SqliteChunkStore::store(const Batch& batch) {
+  sqlite3_exec(writer_db_, "begin;", nullptr, nullptr, nullptr);
+  for (auto& [loc, blob] : batch) {
+    sqlite3_bind_int(store_stmt_, 1, loc[0]);
+    sqlite3_bind_int(store_stmt_, 2, loc[1]);
+    sqlite3_bind_int(store_stmt_, 3, loc[2]);
+    sqlite3_bind_blob(store_stmt_, 4, blob.data(), blob.size(), SQLITE_STATIC);
+    if (sqlite3_step(store_stmt_) != SQLITE_DONE)
+      std::cerr << "Failed to save chunk: " << sqlite3_errmsg(writer_db_) << std::endl;
+    sqlite3_reset(store_stmt_);
+  }
+  if (sqlite3_exec(writer_db_, "commit;", nullptr, nullptr, nullptr) != SQLITE_OK)
+    std::cerr << "Failed to commit chunks: " << sqlite3_errmsg(writer_db_) << std::endl;
+}
+
+std::vector<Location> SqliteChunkStore::get_locations() {
+  std::vector<Location> locs;
+  auto* stmt = prepare(db_, "select x, y, z from Chunk;");
+  while (sqlite3_step(stmt) == SQLITE_ROW)
+    locs.push_back({sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1), sqlite3_column_int(stmt, 2)});
+  sqlite3_finalize(stmt);
+  return locs;
+}
@@ -0,0 +1,31 @@
+#ifndef SQLITE_CHUNK_STORE_H
+#define SQLITE_CHUNK_STORE_H
+
+#include <string>
+#include <sqlite3.h>
+#include "chunk_store.h"
+
+/*
+  Chunks as rows of the Chunk table, keyed by location. Loads and stores each
+  have their own connection, and the database is in WAL mode so loads don't
+  wait on a store. A batch is stored in one transaction.
+*/
+class SqliteChunkStore : public ChunkStore {
+public:
+  explicit SqliteChunkStore(const std::string& path);
+  ~SqliteChunkStore();
+  std::optional<StoredChunk> load(const Location& loc) override;
+  void store(const Batch& batch) override;
+  std::vector<Location> get_locations() override;
+
+  static sqlite3* open(const std::string& path);
+  static sqlite3_stmt* prepare(sqlite3* db, const std::string& sql);
+
+private:
+  sqlite3* db_;
+  sqlite3_stmt* load_stmt_;
+  sqlite3* writer_db_;
+  sqlite3_stmt* store_stmt_;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "terrain_graphics.h"
 #include <cstddef>
+#include <iostream>
 #include <type_traits>
 #include <GLFW/glfw3.h>
 #include "lod_loader.h"
@@ -21,14 +22,14 @@ TerrainGraphics::MultiDrawHandle& TerrainGraphics::get_multi_draw_handle() {
     return irregular_draw_handle_;
   else if constexpr (mesh_kind == MeshKind::water)
     return water_draw_handle_;
+  else
+    return lod_draw_handles_[static_cast<int>(mesh_kind) - static_cast<int>(MeshKind::lod1)];
 }
 
 template <typename T>
 void TerrainGraphics::set_up_vao() {
-  if constexpr (std::is_same_v<T, CubeVertex>) {
-    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(CubeVertex), (void*)offsetof(CubeVertex, data));
-    glEnableVertexAttribArray(0);
-  } else if constexpr (std::is_same_v<T, Vertex>) {
+  // cube faces are pulled from the buffer bound as an SSBO, no attributes
+  if constexpr (std::is_same_v<T, Vertex>) {
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
     glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uvs));
@@ -37,18 +38,36 @@ void TerrainGraphics::set_up_vao() {
     glEnableVertexAttribArray(1);
     glEnableVertexAttribArray(2);
     glEnableVertexAttribArray(3);
+  } else if constexpr (std::is_same_v<T, LodVertex>) {
+    glVertexAttribIPointer(0, 1, GL_UNSIGNED_INT, sizeof(LodVertex), (void*)offsetof(LodVertex, data));
+    glEnableVertexAttribArray(0);
+  } else if constexpr (std::is_same_v<T, HeightfieldVertex>) {
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(HeightfieldVertex), (void*)offsetof(HeightfieldVertex, position));
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(HeightfieldVertex), (void*)offsetof(HeightfieldVertex, normal));
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(HeightfieldVertex), (void*)offsetof(HeightfieldVertex, color));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
   }
 }
 
 template <MeshKind mesh_kind>
 void TerrainGraphics::set_up() {
   using T = VertexKind<mesh_kind>::type;
+  constexpr unsigned int vertices = VertexKind<mesh_kind>::vertices;
   auto& mdh = get_multi_draw_handle<mesh_kind>();
 
   int defacto_vertices = 1;
-  std::size_t buckets = Region::max_sz;
-  if constexpr (mesh_kind == MeshKind::cubes) {
-    defacto_vertices = MeshGenerator::defacto_vertices_per_mesh;
+  // one command per slab of each chunk
+  std::size_t buckets = Region::max_sz * Chunk::num_slabs;
+  if constexpr (VertexKind<mesh_kind>::lod) {
+    // one command per lod, with every slab in it
+    auto level = static_cast<LodLevel>(static_cast<int>(mesh_kind) - static_cast<int>(MeshKind::lod1));
+    buckets = LodLoader::max_meshes(level);
+    defacto_vertices = LodMeshGenerator::defacto_vertices_per_lod_mesh[static_cast<int>(level)];
+    mdh.shader = RenderUtils::create_shader("lod.vs", "lod.fs");
+  } else if constexpr (mesh_kind == MeshKind::cubes) {
+    defacto_vertices = MeshGenerator::defacto_faces_per_mesh;
     mdh.shader = RenderUtils::create_shader("terrain.vs", "terrain.fs");
   } else if constexpr (mesh_kind == MeshKind::irregular) {
     defacto_vertices = MeshGenerator::defacto_vertices_per_irregular_mesh;
@@ -57,6 +76,8 @@ void TerrainGraphics::set_up() {
     defacto_vertices = MeshGenerator::defacto_vertices_per_water_mesh;
     mdh.shader = RenderUtils::create_shader("water.vs", "water.fs");
   }
+  if constexpr (!VertexKind<mesh_kind>::lod)
+    defacto_vertices /= Chunk::num_slabs;
   mdh.commands.reserve(buckets);
   mdh.commands_metadata.reserve(buckets);
 
@@ -77,7 +98,7 @@ void TerrainGraphics::set_up() {
     command.count = 0;
     command.instance_count = 1;
     command.base_instance = 0;
-    command.first = idx * defacto_vertices;
+    command.first = idx * defacto_vertices * vertices;
     metadata.buffer_size = sizeof(T) * defacto_vertices;
   }
   glGenBuffers(1, &mdh.ibo);
@@ -92,6 +113,19 @@ TerrainGraphics::TerrainGraphics() {
   set_up<MeshKind::cubes>();
   set_up<MeshKind::irregular>();
   set_up<MeshKind::water>();
+  set_up<MeshKind::lod1>();
+  set_up<MeshKind::lod2>();
+  set_up<MeshKind::lod3>();
+  set_up<MeshKind::lod4>();
+
+  heightfield_shader_ = RenderUtils::create_shader("heightfield.vs", "heightfield.fs");
+  for (auto& level : heightfield_levels_) {
+    glGenBuffers(1, &level.vbo);
+    glGenVertexArrays(1, &level.vao);
+    glBindBuffer(GL_ARRAY_BUFFER, level.vbo);
+    glBindVertexArray(level.vao);
+    set_up_vao<HeightfieldVertex>();
+  }
 
   glGenTextures(1, &voxel_texture_array_);
   glBindTexture(GL_TEXTURE_2D_ARRAY, voxel_texture_array_);
@@ -141,28 +175,43 @@ TerrainGraphics::TerrainGraphics() {
     "irregular_shadow.fs");
 }
 
-void TerrainGraphics::create(const Location& loc, const MeshGenerator& mesh_generator) {
-  upload<MeshKind::cubes>(loc, mesh_generator.get_mesh(loc));
-  upload<MeshKind::irregular>(loc, mesh_generator.get_irregular_mesh(loc));
-  upload<MeshKind::water>(loc, mesh_generator.get_water_mesh(loc));
+void TerrainGraphics::create(const SlabLocation& loc, const MeshGenerator::SlabMesh& slab_mesh) {
+  upload<MeshKind::cubes>(loc, slab_mesh.mesh);
+  upload<MeshKind::irregular>(loc, slab_mesh.irregular_mesh);
+  upload<MeshKind::water>(loc, slab_mesh.water_mesh);
 }
 
 template <MeshKind mesh_kind>
 void TerrainGraphics::upload(
-  const Location& loc,
+  const SlabLocation& loc,
   const std::vector<typename VertexKind<mesh_kind>::type>& mesh) {
   using T = VertexKind<mesh_kind>::type;
+  constexpr unsigned int vertices = VertexKind<mesh_kind>::vertices;
   MultiDrawHandle& mdh = get_multi_draw_handle<mesh_kind>();
   std::size_t idx;
   if (mdh.loc_to_command_index.contains(loc)) {
     idx = mdh.loc_to_command_index[loc];
   } else {
-    idx = mdh.first_unoccupied++;
-    auto& metadata = mdh.commands_metadata[idx];
+    if (!mdh.free_commands.empty()) {
+      idx = mdh.free_commands.back();
+      mdh.free_commands.pop_back();
+    } else if (mdh.first_unoccupied < mdh.commands.size()) {
+      idx = mdh.first_unoccupied++;
+    } else {
+      // there are commands for the most meshes ever drawn, so this is a bug
+      static bool reported = false;
+      if (!reported) {
+        std::cerr << "Out of draw commands" << std::endl;
+        reported = true;
+      }
+      return;
+    }
 
-    float loc_x = (loc[0] - origin_[0]) * Chunk::sz_x;
-    float loc_y = (loc[1] - origin_[1]) * Chunk::sz_y;
-    float loc_z = (loc[2] - origin_[2]) * Chunk::sz_z;
+    // faces are relative to the chunk, not the slab
+    auto& chunk_loc = loc.location;
+    float loc_x = (chunk_loc[0] - origin_[0]) * Chunk::sz_x;
+    float loc_y = (chunk_loc[1] - origin_[1]) * Chunk::sz_y;
+    float loc_z = (chunk_loc[2] - origin_[2]) * Chunk::sz_z;
 
     auto loc = glm::vec4(loc_x, loc_y, loc_z, 0.f);
     int ssbo_vec4_offset = sizeof(glm::vec4) * idx;
@@ -190,7 +239,7 @@ void TerrainGraphics::upload(
     glBufferData(GL_COPY_WRITE_BUFFER, mdh.vbo_size + added_size, nullptr, GL_STATIC_DRAW);
 
     // Copy beginning of old buffer
-    int pre_size = command.first * sizeof(T);
+    int pre_size = command.first / vertices * sizeof(T);
     glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, pre_size);
 
     // Copy this mesh
@@ -214,9 +263,9 @@ void TerrainGraphics::upload(
     // Shift the first index of every command following this one
     for (int i = idx + 1; i < mdh.commands.size(); ++i) {
       auto& command = mdh.commands[i];
-      command.first += (added_size / sizeof(T));
+      command.first += (added_size / sizeof(T)) * vertices;
     }
-    command.count = mesh.size();
+    command.count = mesh.size() * vertices;
 
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mdh.ibo);
     glBufferSubData(GL_DRAW_INDIRECT_BUFFER, idx * sizeof(DrawArraysIndirectCommand), sizeof(DrawArraysIndirectCommand) * (mdh.commands.size() - idx), mdh.commands.data() + idx);
@@ -231,9 +280,9 @@ void TerrainGraphics::upload(
 
   } else {
     glBindBuffer(GL_ARRAY_BUFFER, mdh.vbo);
-    glBufferSubData(GL_ARRAY_BUFFER, sizeof(T) * command.first, mesh_size_bytes, mesh.data());
+    glBufferSubData(GL_ARRAY_BUFFER, sizeof(T) * (command.first / vertices), mesh_size_bytes, mesh.data());
 
-    command.count = mesh.size();
+    command.count = mesh.size() * vertices;
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mdh.ibo);
     glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * idx, sizeof(DrawArraysIndirectCommand), &command);
   }
@@ -241,21 +290,65 @@ void TerrainGraphics::upload(
   mdh.loc_to_command_index[loc] = idx;
 }
 
-void TerrainGraphics::remove(const Location& loc, MultiDrawHandle& mdh) {
-  auto idx = mdh.loc_to_command_index[loc];
+void TerrainGraphics::remove(const SlabLocation& loc, MultiDrawHandle& mdh) {
+  auto it = mdh.loc_to_command_index.find(loc);
+  if (it == mdh.loc_to_command_index.end())
+    return;
+  auto idx = it->second;
   auto& command = mdh.commands[idx];
-  auto& metadata = mdh.commands_metadata[idx];
   command.count = 0;
   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mdh.ibo);
   glBufferSubData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawArraysIndirectCommand) * idx, sizeof(DrawArraysIndirectCommand), &command);
-  mdh.loc_to_command_index.erase(loc);
-  mdh.first_unoccupied = idx;
+  mdh.loc_to_command_index.erase(it);
+  mdh.free_commands.push_back(idx);
 }
 
 void TerrainGraphics::destroy(const Location& loc) {
-  remove(loc, cubes_draw_handle_);
-  remove(loc, irregular_draw_handle_);
-  remove(loc, water_draw_handle_);
+  for (int slab = 0; slab < Chunk::num_slabs; ++slab) {
+    SlabLocation slab_loc{loc, slab};
+    remove(slab_loc, cubes_draw_handle_);
+    remove(slab_loc, irregular_draw_handle_);
+    remove(slab_loc, water_draw_handle_);
+  }
+}
+
+void TerrainGraphics::create_lod(const Location& loc, LodLevel level, const std::vector<LodVertex>& mesh) {
+  // the lod may be moving between levels
+  destroy_lod(loc);
+  SlabLocation slab_loc{loc, 0};
+  switch (level) {
+  case LodLevel::lod1:
+    upload<MeshKind::lod1>(slab_loc, mesh);
+    break;
+  case LodLevel::lod2:
+    upload<MeshKind::lod2>(slab_loc, mesh);
+    break;
+  case LodLevel::lod3:
+    upload<MeshKind::lod3>(slab_loc, mesh);
+    break;
+  case LodLevel::lod4:
+    upload<MeshKind::lod4>(slab_loc, mesh);
+    break;
+  }
+}
+
+void TerrainGraphics::destroy_lod(const Location& loc) {
+  for (auto& mdh : lod_draw_handles_)
+    remove(SlabLocation{loc, 0}, mdh);
+}
+
+void TerrainGraphics::create_heightfield_level(const HeightfieldClipmap::LevelMesh& level_mesh) {
+  auto& level = heightfield_levels_[level_mesh.level];
+  auto& mesh = level_mesh.mesh;
+  glBindBuffer(GL_ARRAY_BUFFER, level.vbo);
+  if (mesh.size() > level.capacity) {
+    level.capacity = mesh.size();
+    glBufferData(GL_ARRAY_BUFFER, sizeof(HeightfieldVertex) * mesh.size(), mesh.data(), GL_DYNAMIC_DRAW);
+  } else {
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(HeightfieldVertex) * mesh.size(), mesh.data());
+  }
+  level.count = mesh.size();
+  level.center = level_mesh.center;
 }
 
 void TerrainGraphics::render(const Renderer& renderer, const MultiDrawHandle& mdh) const {
@@ -292,6 +385,9 @@ void TerrainGraphics::render(const Renderer& renderer, const MultiDrawHandle& md
 }
 
 void TerrainGraphics::shadow_map(const Renderer& renderer) const {
+  // render_lods leaves binding 1 on the last lod level's chunk positions
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cubes_draw_handle_.loc_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cubes_draw_handle_.vbo);
   glUseProgram(cubes_shadow_shader_);
   glBindVertexArray(cubes_draw_handle_.vao);
   glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cubes_draw_handle_.ibo);
@@ -307,10 +403,43 @@ void TerrainGraphics::shadow_map(const Renderer& renderer) const {
 
 void TerrainGraphics::render(const Renderer& renderer) const {
   glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, cubes_draw_handle_.loc_ssbo);
+  glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, cubes_draw_handle_.vbo);
   render(renderer, cubes_draw_handle_);
   //render(renderer, irregular_draw_handle_);
 }
 
+void TerrainGraphics::render_lods(const Renderer& renderer) const {
+  constexpr std::array<int, 4> scales = {
+    ChunkLod<LodLevel::lod1>::scale,
+    ChunkLod<LodLevel::lod2>::scale,
+    ChunkLod<LodLevel::lod3>::scale,
+    ChunkLod<LodLevel::lod4>::scale};
+  for (std::size_t i = 0; i < lod_draw_handles_.size(); ++i) {
+    auto& mdh = lod_draw_handles_[i];
+    glProgramUniform1f(mdh.shader, glGetUniformLocation(mdh.shader, "uScale"), scales[i]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, mdh.loc_ssbo);
+    render(renderer, mdh);
+  }
+}
+
+void TerrainGraphics::render_heightfield(const Renderer& renderer) const {
+  glUseProgram(heightfield_shader_);
+  auto transform = renderer.get_projection_matrix() * renderer.get_view_matrix();
+  glUniformMatrix4fv(glGetUniformLocation(heightfield_shader_, "uTransform"), 1, GL_FALSE, glm::value_ptr(transform));
+  auto offset_loc = glGetUniformLocation(heightfield_shader_, "uOffset");
+  for (auto& level : heightfield_levels_) {
+    if (level.count == 0)
+      continue;
+    auto offset = glm::vec3(
+      (level.center[0] - origin_[0]) * Chunk::sz_x,
+      -origin_[1] * Chunk::sz_y,
+      (level.center[1] - origin_[2]) * Chunk::sz_z);
+    glUniform3fv(offset_loc, 1, glm::value_ptr(offset));
+    glBindVertexArray(level.vao);
+    glDrawArrays(GL_TRIANGLES, 0, level.count);
+  }
+}
+
 void TerrainGraphics::render_irregular(const Renderer& renderer) const {
   render(renderer, irregular_draw_handle_);
 }
@@ -5,6 +5,7 @@
 #include <unordered_map>
 #include <vector>
 #include <GL/glew.h>
+#include "heightfield_clipmap.h"
 #include "lod_mesh_generator.h"
 #include "mesh_generator.h"
 #include "mesh_utils.h"
@@ -17,14 +18,22 @@ enum class MeshKind {
   cubes,
   irregular,
   water,
+  lod1,
+  lod2,
+  lod3,
+  lod4,
 };
 
 template <MeshKind mesh_kind>
 struct VertexKind {
+  static constexpr bool lod = mesh_kind >= MeshKind::lod1;
   using type = std::conditional_t<
     mesh_kind == MeshKind::cubes,
-    CubeVertex,
-    Vertex>;
+    CubeFace,
+    std::conditional_t<lod, LodVertex, Vertex>>;
+  // vertices drawn per element of the buffer, cube faces are expanded in the
+  // vertex shader
+  static constexpr unsigned int vertices = mesh_kind == MeshKind::cubes ? 6 : 1;
 };
 
 class TerrainGraphics {
@@ -33,9 +42,14 @@ public:
   void render(const Renderer& renderer) const;
   void render_irregular(const Renderer& renderer) const;
   void render_water(const Renderer& renderer) const;
+  void render_lods(const Renderer& renderer) const;
+  void render_heightfield(const Renderer& renderer) const;
   void shadow_map(const Renderer& renderer) const;
-  void create(const Location& loc, const MeshGenerator& mesh_generator);
+  void create(const SlabLocation& loc, const MeshGenerator::SlabMesh& slab_mesh);
   void destroy(const Location& loc);
+  void create_lod(const Location& loc, LodLevel level, const std::vector<LodVertex>& mesh);
+  void destroy_lod(const Location& loc);
+  void create_heightfield_level(const HeightfieldClipmap::LevelMesh& level_mesh);
   void new_origin(const Location& loc);
 
 private:
@@ -58,16 +72,18 @@ private:
     std::vector<DrawArraysIndirectCommand> commands;
     std::vector<CommandMetadata> commands_metadata;
     unsigned int vbo_size = 0;
-    std::unordered_map<Location, std::size_t, LocationHash> loc_to_command_index;
+    std::unordered_map<SlabLocation, std::size_t, SlabLocationHash> loc_to_command_index;
     std::size_t first_unoccupied = 0;
+    // commands freed by remove, reused before first_unoccupied
+    std::vector<std::size_t> free_commands;
     GLuint loc_ssbo;
   };
 
   template <MeshKind mesh_kind>
   void upload(
-    const Location& loc,
+    const SlabLocation& loc,
     const std::vector<typename VertexKind<mesh_kind>::type>& mesh);
-  void remove(const Location& loc, MultiDrawHandle& mdh);
+  void remove(const SlabLocation& loc, MultiDrawHandle& mdh);
   void render(const Renderer& renderer, const MultiDrawHandle& mdh) const;
   template <MeshKind mesh_kind>
   MultiDrawHandle& get_multi_draw_handle();
@@ -87,6 +103,22 @@ private:
   GLuint normal_map1;
   GLuint normal_map2;
 
+  // specific for lods, one per level. Lod meshes cover whole chunks and are
+  // keyed as slab 0.
+  std::array<MultiDrawHandle, 4> lod_draw_handles_;
+
+  // specific for the heightfield, one buffer per clipmap level, replaced
+  // whole when the level is rebuilt
+  struct HeightfieldLevel {
+    GLuint vbo;
+    GLuint vao;
+    unsigned int count = 0;
+    unsigned int capacity = 0;
+    Location2D center;
+  };
+  std::array<HeightfieldLevel, HeightfieldClipmap::num_levels> heightfield_levels_;
+  GLuint heightfield_shader_;
+
   // universal
   GLuint voxel_texture_array_;
   Location origin_;
@@ -130,6 +130,22 @@ struct LocationHash {
   }
 };
 
+// A horizontal slab of a chunk, terrain is meshed and drawn a slab at a time
+struct SlabLocation {
+  Location location;
+  int slab;
+
+  bool operator==(const SlabLocation& other) const = default;
+};
+
+struct SlabLocationHash {
+  std::size_t operator()(const SlabLocation& l) const {
+    std::size_t hashValue = LocationHash{}(l.location);
+    hashValue ^= std::hash<int>{}(l.slab) + 0x9e3779b9 + (hashValue << 6) + (hashValue >> 2);
+    return hashValue;
+  }
+};
+
 struct Location2DHash {
   template <class T, std::size_t N>
   size_t operator()(const std::array<T, N>& arr) const noexcept {
@@ -147,47 +163,66 @@ struct Vertex {
   int textureId;
 };
 
+// A corner of the far terrain heightfield, in voxels from the centre of its
+// clipmap level
+struct HeightfieldVertex {
+  glm::vec3 position;
+  glm::vec3 normal;
+  glm::vec3 color;
+};
+
+// A corner of a lod face, packed into 32 bits. Positions are in voxels of the
+// lod, lod.vs scales them up to chunk voxels.
 class LodVertex {
 public:
   unsigned int data = 0;
   LodVertex(int x, int y, int z, Direction normal, QuadCorner uvs, int textureId) {
     data |= (x & xpos_mask);
-    data |= ((y << 4) & ypos_mask);
-    data |= ((z << 9) & zpos_mask);
-    data |= ((normal << 13) & normal_mask);
-    data |= ((uvs << 16) & uvs_mask);
-    data |= ((textureId << 18) & texture_mask);
+    data |= ((y << 5) & ypos_mask);
+    data |= ((z << 10) & zpos_mask);
+    data |= ((normal << 15) & normal_mask);
+    data |= ((uvs << 18) & uvs_mask);
+    data |= ((textureId << 20) & texture_mask);
   }
 
 private:
-  static constexpr unsigned int xpos_mask = common::create_bitmask(0, 3);
-  static constexpr unsigned int ypos_mask = common::create_bitmask(4, 8);
-  static constexpr unsigned int zpos_mask = common::create_bitmask(9, 12);
-  static constexpr unsigned int normal_mask = common::create_bitmask(13, 15);
-  static constexpr unsigned int uvs_mask = common::create_bitmask(16, 17);
-  static constexpr unsigned int texture_mask = common::create_bitmask(18, 31);
+  static constexpr unsigned int xpos_mask = common::create_bitmask(0, 4);
+  static constexpr unsigned int ypos_mask = common::create_bitmask(5, 9);
+  static constexpr unsigned int zpos_mask = common::create_bitmask(10, 14);
+  static constexpr unsigned int normal_mask = common::create_bitmask(15, 17);
+  static constexpr unsigned int uvs_mask = common::create_bitmask(18, 19);
+  static constexpr unsigned int texture_mask = common::create_bitmask(20, 31);
 };
 
-class CubeVertex {
+// A visible cube face, or a rectangle of merged faces, packed into 32 bits.
+// (x, y, z) is the voxel with the lowest coordinates, width and height run
+// along the lower and higher numbered of the other two axes. terrain.vs
+// expands each face into two triangles.
+class CubeFace {
 public:
   unsigned int data = 0;
 
-  CubeVertex(int x, int y, int z, Direction normal, QuadCorner uvs, int textureId) {
+  CubeFace(int x, int y, int z, Direction normal, int width, int height, int textureId) {
     data |= (x & xpos_mask);
-    data |= ((y << 6) & ypos_mask);
-    data |= ((z << 12) & zpos_mask);
-    data |= ((normal << 18) & normal_mask);
-    data |= ((uvs << 21) & uvs_mask);
-    data |= ((textureId << 23) & texture_mask);
+    data |= ((y << 5) & ypos_mask);
+    data |= ((z << 10) & zpos_mask);
+    data |= ((normal << 15) & normal_mask);
+    data |= (((width - 1) << 18) & width_mask);
+    data |= (((height - 1) << 22) & height_mask);
+    data |= ((textureId << 26) & texture_mask);
   }
 
+  static constexpr int max_size = 16;
+  static constexpr int max_textures = 64;
+
 private:
-  static constexpr unsigned int xpos_mask = common::create_bitmask(0, 5);
-  static constexpr unsigned int ypos_mask = common::create_bitmask(6, 11);
-  static constexpr unsigned int zpos_mask = common::create_bitmask(12, 17);
-  static constexpr unsigned int normal_mask = common::create_bitmask(18, 20);
-  static constexpr unsigned int uvs_mask = common::create_bitmask(21, 22);
-  static constexpr unsigned int texture_mask = common::create_bitmask(23, 31);
+  static constexpr unsigned int xpos_mask = common::create_bitmask(0, 4);
+  static constexpr unsigned int ypos_mask = common::create_bitmask(5, 9);
+  static constexpr unsigned int zpos_mask = common::create_bitmask(10, 14);
+  static constexpr unsigned int normal_mask = common::create_bitmask(15, 17);
+  static constexpr unsigned int width_mask = common::create_bitmask(18, 21);
+  static constexpr unsigned int height_mask = common::create_bitmask(22, 25);
+  static constexpr unsigned int texture_mask = common::create_bitmask(26, 31);
 };
 
 namespace QuadCoord {
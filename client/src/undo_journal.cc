@@ -0,0 +1,72 @@
+#include "undo_journal.h"
+
+#include <algorithm>
+
+std::size_t UndoJournal::max_bytes = 16 << 20;
+
+void UndoJournal::begin_update() {
+  close_update();
+  is_open_ = true;
+}
+
+void UndoJournal::record(const Location& loc, int idx, Voxel before) {
+  is_open_ = true;
+  auto& delta = open_[loc];
+  if (delta.recorded.test(idx))
+    return;
+  delta.recorded.set(idx);
+  delta.edits.push_back({static_cast<std::uint16_t>(idx), before});
+}
+
+std::optional<UndoJournal::Update> UndoJournal::pop_update() {
+  close_update();
+  if (updates_.empty())
+    return std::nullopt;
+  auto update = std::move(updates_.back());
+  updates_.pop_back();
+  for (auto& delta : update)
+    bytes_ -= sizeof(ChunkDelta) + delta.runs.size();
+  return update;
+}
+
+std::size_t UndoJournal::get_memory_usage() const {
+  std::size_t usage = bytes_;
+  for (auto& [loc, delta] : open_)
+    usage += sizeof(OpenDelta) + delta.edits.size() * sizeof(delta.edits[0]);
+  return usage;
+}
+
+void UndoJournal::close_update() {
+  if (!is_open_)
+    return;
+  is_open_ = false;
+  Update update;
+  for (auto& [loc, open] : open_) {
+    auto& edits = open.edits;
+    std::ranges::sort(edits);
+    ChunkDelta delta{loc, {}};
+    int end = 0;
+    for (std::size_t j = 0; j < edits.size();) {
+      auto [start, voxel] = edits[j];
+      std::size_t k = j + 1;
+      while (k < edits.size() && edits[k].first == edits[k - 1].first + 1 && edits[k].second == voxel)
+        ++k;
+      Varint::write(delta.runs, start - end);
+      Varint::write(delta.runs, k - j);
+      delta.runs.push_back(static_cast<unsigned char>(voxel));
+      end = start + (k - j);
+      j = k;
+    }
+    delta.runs.shrink_to_fit();
+    bytes_ += sizeof(ChunkDelta) + delta.runs.size();
+    update.push_back(std::move(delta));
+  }
+  open_.clear();
+  updates_.push_back(std::move(update));
+
+  while (bytes_ > max_bytes && !updates_.empty()) {
+    for (auto& delta : updates_.front())
+      bytes_ -= sizeof(ChunkDelta) + delta.runs.size();
+    updates_.pop_front();
+  }
+}
@@ -0,0 +1,71 @@
+#ifndef UNDO_JOURNAL_H
+#define UNDO_JOURNAL_H
+
+#include <bitset>
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "chunk.h"
+#include "types.h"
+#include "varint.h"
+#include "voxel.h"
+
+/*
+  What voxels were before each update, so updates can be undone latest
+  first. While an update is open its first edit of each voxel is kept as is.
+  When it is closed, each chunk's edits become runs of consecutive indices
+  with the same old voxel, written as varints: the gap from the end of the
+  previous run, the length, then the voxel byte. Once the closed updates take
+  more than max_bytes the oldest are dropped, even the latest if it is too
+  big on its own.
+*/
+class UndoJournal {
+public:
+  struct ChunkDelta {
+    Location location;
+    std::vector<unsigned char> runs;
+  };
+  using Update = std::vector<ChunkDelta>;
+
+  void begin_update();
+  void record(const Location& loc, int idx, Voxel before);
+  std::optional<Update> pop_update();
+  std::size_t get_memory_usage() const;
+
+  // Calls f(index, count, voxel) for each run of the delta
+  template <typename F>
+  static void for_each_run(const ChunkDelta& delta, F&& f) {
+    auto* data = delta.runs.data();
+    int data_size = delta.runs.size();
+    int pos = 0;
+    int i = 0;
+    while (pos < data_size) {
+      i += Varint::read(data, data_size, pos);
+      int count = Varint::read(data, data_size, pos);
+      if (pos >= data_size || i + count > Chunk::sz)
+        return;
+      f(i, count, static_cast<Voxel>(data[pos++]));
+      i += count;
+    }
+  }
+
+  static std::size_t max_bytes;
+
+private:
+  struct OpenDelta {
+    std::vector<std::pair<std::uint16_t, Voxel>> edits;
+    std::bitset<Chunk::sz> recorded;
+  };
+
+  void close_update();
+
+  std::deque<Update> updates_;
+  std::size_t bytes_ = 0;
+  std::unordered_map<Location, OpenDelta, LocationHash> open_;
+  bool is_open_ = false;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <cstdint>
+#include <vector>
+
+// LEB128: seven bits per byte, low bits first, top bit set on all but the last
+namespace Varint {
+  inline void write(std::vector<unsigned char>& data, std::uint32_t value) {
+    while (value >= 0x80) {
+      data.push_back(static_cast<unsigned char>(value | 0x80));
+      value >>= 7;
+    }
+    data.push_back(static_cast<unsigned char>(value));
+  }
+
+  // Returns 0 if the varint runs past the end
+  inline std::uint32_t read(const unsigned char* data, int data_size, int& pos) {
+    std::uint32_t value = 0;
+    for (int shift = 0; pos < data_size && shift < 32; shift += 7) {
+      auto byte = data[pos++];
+      value |= static_cast<std::uint32_t>(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return value;
+    }
+    return 0;
+  }
+} // namespace Varint
+
+#endif
@@ -7,8 +7,9 @@
 /*
   The boundary markers are really for the sake of meshing
   They shouldn't be used or extended for gameplay logic
+  Backed by a single byte so chunks can store voxels compactly
 */
-enum class Voxel {
+enum class Voxel : std::uint8_t {
   empty,
 
   WATER_LOWER,
@@ -0,0 +1,55 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "chunk_store.h"
+#include "common.h"
+
+/*
+  Copies every chunk from one ChunkStore backend to the other, re-encoding
+  each with the current codec. Edit logs are copied as they are. The source is left as it is. Chunks are copied
+  in batches so the destination never holds more than one batch in memory.
+  Usage: migrate_chunks sqlite|regions sqlite|regions [data dir]
+*/
+
+static bool parse_backend(const std::string& name, ChunkStore::Backend& backend) {
+  if (name == "sqlite")
+    backend = ChunkStore::Backend::sqlite;
+  else if (name == "regions")
+    backend = ChunkStore::Backend::region_files;
+  else
+    return false;
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  ChunkStore::Backend from, to;
+  if (argc < 3 || !parse_backend(argv[1], from) || !parse_backend(argv[2], to) || from == to) {
+    std::cerr << "Usage: migrate_chunks sqlite|regions sqlite|regions [data dir]" << std::endl;
+    return 1;
+  }
+  std::string dir = argc > 3 ? argv[3] : common::get_data_dir();
+
+  auto start = std::chrono::steady_clock::now();
+  auto source = ChunkStore::create(from, dir);
+  auto destination = ChunkStore::create(to, dir);
+  auto locs = source->get_locations();
+  constexpr std::size_t batch_sz = 4096;
+  ChunkStore::Batch batch;
+  std::size_t copied = 0;
+  for (auto& loc : locs) {
+    auto chunk = source->load(loc);
+    if (!chunk)
+      continue;
+    batch[loc] = std::visit([](const auto& stored) { return stored.encode(); }, *chunk);
+    if (batch.size() == batch_sz) {
+      destination->store(batch);
+      copied += batch.size();
+      batch.clear();
+    }
+  }
+  destination->store(batch);
+  copied += batch.size();
+
+  auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  std::cout << "Copied " << copied << " chunks in " << ms << " ms" << std::endl;
+}